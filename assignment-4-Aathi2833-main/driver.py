@@ -56,6 +56,64 @@ twoleveltests_json = """{
     }   
     }"""
 
+# Model tests: unit tests of the cache API, and the simulation modes
+# checked against the serial path
+modeltests_json = """{
+  "unittests": {
+      "./model/test-cache": 10
+      },
+  "pipelined": {
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -p -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -p -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10
+      },
+  "decoded": {
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -D 4 -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -D 4 -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10
+      },
+  "sharded": {
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -j 4 -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -j 4 -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10
+      },
+  "reordered": {
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -R -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -R -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -W 1000 -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -W 1000 -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10
+      },
+  "timesharded": {
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -T 4 -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -T 4 -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 8 -E 2 -b 4 -t ./model/traces/long.trace) <(./model/cache -v -T 3 -w 0 -s 8 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null)": 10,
+      "diff <(./model/cache -v -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace) <(./model/cache -v -T 3 -w 0 -s 4 -E 4 -b 5 -F -a 16 -t ./model/traces/long.trace 2>/dev/null)": 10
+      },
+  "setsampled": {
+      "paste -d' ' <(./model/cache -s 8 -E 2 -b 4 -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -s 8 -E 2 -b 4 -k 8 -t ./model/traces/long.trace | grep -o -E '(hits|misses):[0-9]*' | sed 's/[a-z]*://' | tr '\\n' ' ') | awk '{ for (i = 1; i <= 2; i++) { d = \\$i - \\$(i + 2); if (d < 0) d = -d; if (d > \\$(i + 4)) bad = 1 } } END { exit bad || NF != 6 }'": 10,
+      "./model/cache -s 8 -E 2 -b 4 -k 8 -t ./model/traces/long.trace | grep -q 'load per set is skewed'": 10,
+      "paste -d' ' <(./model/cache -s 8 -E 1 -b 2 -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -s 8 -E 1 -b 2 -k 4 -t ./model/traces/long.trace | grep -o -E '(hits|misses):[0-9]*' | sed 's/[a-z]*://' | tr '\\n' ' ') | awk '{ for (i = 1; i <= 2; i++) { d = \\$i - \\$(i + 2); if (d < 0) d = -d; if (d > \\$(i + 4)) bad = 1 } } END { exit bad || NF != 6 }'": 10,
+      "! ./model/cache -s 8 -E 1 -b 2 -k 4 -t ./model/traces/long.trace | grep -q 'load per set is skewed'": 10
+      },
+  "swept": {
+      "diff <(./model/cache -s 3 -E 2 -b 4 -L -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -G 's=2-4 E=1,2 b=4 p=LF' -t ./model/traces/long.trace | grep '^ *3 *2 *4 *LRU ' | tr -s ' ' | cut -d' ' -f7-9)": 10,
+      "diff <(./model/cache -s 3 -E 2 -b 4 -F -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -G 's=2-4 E=1,2 b=4 p=LF' -t ./model/traces/long.trace | grep '^ *3 *2 *4 *LFU ' | tr -s ' ' | cut -d' ' -f7-9)": 10,
+      "diff <(./model/cache -G 's=8-10 E=2,4 b=8 p=Lf' -t ./model/traces/long.trace) <(./model/cache -P -G 's=8-10 E=2,4 b=8 p=Lf' -t ./model/traces/long.trace)": 10,
+      "! ./model/cache -P -G 's=4 E=2 b=4' -t ./model/traces/long.trace > /dev/null": 10
+      },
+  "surface": {
+      "diff <(./model/cache -s 4 -E 6 -b 4 -L -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]*' | tr ':' ' ' | awk -v OFMT=%.6f '{ print \\$4 / (\\$2 + \\$4) }') <(./model/cache -S -s 4 -E 6 -b 4 -t ./model/traces/long.trace | grep '^ *4 ' | tr -s ' ' | cut -d' ' -f8)": 10,
+      "diff <(./model/cache -s 2 -E 2 -b 4 -L -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]*' | tr ':' ' ' | awk -v OFMT=%.6f '{ print \\$4 / (\\$2 + \\$4) }') <(./model/cache -S -s 4 -E 6 -b 4 -t ./model/traces/long.trace | grep '^ *2 ' | tr -s ' ' | cut -d' ' -f4)": 10
+      },
+  "shards": {
+      "diff <(./model/cache -r 1 -s 0 -E 64 -b 4 -t ./model/traces/long.trace | grep -E '^ +[0-9]+ +[0-9]+ +[0-9.]+ ' | tr -s ' ' | cut -d' ' -f4) <(./model/cache -S -s 0 -E 64 -b 4 -t ./model/traces/long.trace | grep '^ *0 ' | tr -s ' ' | cut -d' ' -f3,4,6,10,18,34,66 | tr ' ' '\\n')": 10,
+      "paste -d' ' <(./model/cache -m 5000 -s 0 -E 64 -b 4 -t ./model/traces/long.trace | grep -E '^ +[0-9]+ +[0-9]+ +[0-9.]+ ' | tr -s ' ' | cut -d' ' -f2,4,5) <(./model/cache -S -s 0 -E 64 -b 4 -t ./model/traces/long.trace | grep '^ *0 ' | tr -s ' ' | cut -d' ' -f3,4,6,10,18,34,66 | tr ' ' '\\n') | awk '\\$1 >= 8 { d = \\$2 - \\$4; if (d < 0) d = -d; if (d > \\$3) bad = 1; n++ } END { exit bad || n != 4 }'": 10
+      },
+  "phased": {
+      "diff <(./model/cache -s 4 -E 2 -b 4 -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -I 2000 -K 134 -s 4 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g')": 10,
+      "paste -d' ' <(./model/cache -s 4 -E 2 -b 4 -t ./model/traces/long.trace | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g') <(./model/cache -I 2000 -s 4 -E 2 -b 4 -t ./model/traces/long.trace 2>/dev/null | grep -o 'hits:[0-9]* misses:[0-9]* evictions:[0-9]*' | sed 's/[a-z]*://g') | awk '{ d = \\$2 - \\$5; if (d < 0) d = -d; exit NF != 6 || d > 0.05 * \\$2 }'": 10,
+      "! ./model/cache -K 4 -s 4 -E 2 -b 4 -t ./model/traces/long.trace > /dev/null": 10
+      }
+    }
+"""
+
 # Points in this case specified by driver2.py
 trans_tests_json = """{
   "test-trans": {
@@ -217,6 +275,11 @@ def main():
     for parts in test_dict.keys():
         rundifftests(test_dict[parts], parts)
 
+    # Model Tests
+    test_dict = json.loads(modeltests_json)
+    for parts in test_dict.keys():
+        rundifftests(test_dict[parts], parts)
+
 
     # test_dict = json.loads(trans_tests_json)
     # for parts in test_dict.keys():
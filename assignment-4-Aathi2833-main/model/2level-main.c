@@ -2,6 +2,7 @@
 #include "dogfault.h"
 #include "fileio.h"
 #include "json.h"
+#include "trace.h"
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -16,8 +17,8 @@
 void validate_2level(const Cache *L1, const Cache *L2) {
   for (int i = 0; i < (1 << L1->setBits); i++)
     for (int j = 0; j < L1->linesPerSet; j++)
-      if (L1->sets[i].lines[j].valid)
-        assert(probe_cache(L1->sets[i].lines[j].block_addr, L2) &&
+      if (line_valid(L1, i, j))
+        assert(probe_cache(line_block(L1, i, j), L2) &&
                "Inclusive Property Violation: L1 Cache Block not found in L2 "
                "Cache.");
 }
@@ -25,12 +26,12 @@ void validate_2level(const Cache *L1, const Cache *L2) {
 // address is in the cache.
 
 void runTrace(char *traceFile, Cache *L1, Cache *L2) {
-  FILE *input = fopen(traceFile, "r");
-  int size;
-  char operation;
-  unsigned long long address;
-  result r_L1, r_L2;
-  while (fscanf(input, " %c %llx,%d", &operation, &address, &size) == 3) {
+  trace_reader input;
+  trace_record record;
+  trace_open(&input, traceFile);
+  while (trace_next(&input, &record)) {
+    char operation = record.op;
+    unsigned long long address = record.address;
     printf("\n%c %llx,", operation, address);
 
     if (operation != 'M' && operation != 'L' && operation != 'S') {
@@ -39,49 +40,6 @@ void runTrace(char *traceFile, Cache *L1, Cache *L2) {
 
     // TODO: Operate L1 and L2 cache to implement
     // 2-level inclusive cache model
-    void runTrace(char *traceFile, Cache *L1, Cache *L2) {
-  FILE *input = fopen(traceFile, "r");
-  int size;
-  char operation;
-  unsigned long long address;
-  result r_L1, r_L2;
-  
-  while (fscanf(input, " %c %llx,%d", &operation, &address, &size) == 3) {
-    printf("\n%c %llx,", operation, address);
-
-    if (operation != 'M' && operation != 'L' && operation != 'S') {
-      continue;
-    }
-
-    // Access L1 Cache
-    r_L1 = operateCache(L1, address);
-    
-    // L1 Hit
-    if (r_L1.hit) {
-      printf(" L1 Hit");
-    } else {
-      printf(" L1 Miss");
-      
-      // Access L2 Cache
-      r_L2 = operateCache(L2, address);
-      
-      // L2 Hit
-      if (r_L2.hit) {
-        printf(" L2 Hit");
-        
-        // Update L1 with L2 data (inclusive)
-        updateCache(L1, address, r_L2.data);
-      } else {
-        printf(" L2 Miss");
-        
-        // Update both L1 and L2 with new data
-        updateCache(L1, address, NULL); // Update L1 with empty data
-        updateCache(L2, address, NULL); // Update L2 with empty data
-      }
-    }
-  }
-  fclose(input);
-}
     // Operate L1 cache first.
     // If miss, operate L2 cache
     // Consider evictions in L1 and L2. What would happen if block evicted from
@@ -93,7 +51,7 @@ void runTrace(char *traceFile, Cache *L1, Cache *L2) {
     }
     validate_2level(L1, L2);
   }
-  fclose(input);
+  trace_close(&input);
 }
 
 int main(int argc, char *argv[]) {
@@ -164,11 +122,20 @@ int main(int argc, char *argv[]) {
   opterr = 0;
   Cache L1;
   L1.lfu = lfu;
+  L1.lfuAging = 0;
+  L1.indexed = 1;
+  L1.hugePages = 0;
+  L1.packed = 0;
   L1.displayTrace = 1;
   // TODO: Initialize L1 cache
 
   Cache L2;
   L2.lfu = lfu;
+  L2.lfuAging = 0;
+  // Back-invalidations flush blocks by address.
+  L2.indexed = 1;
+  L2.hugePages = 0;
+  L2.packed = 0;
   L2.displayTrace = 1;
   // TODO: Initialize L2 cache
   runTrace(traceFile, &L1, &L2);
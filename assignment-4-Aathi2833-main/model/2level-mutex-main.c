@@ -2,6 +2,7 @@
 #include "dogfault.h"
 #include "fileio.h"
 #include "json.h"
+#include "trace.h"
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -14,20 +15,21 @@
 void validate_2level(const Cache *L1, const Cache *L2) {
   for (int i = 0; i < (1 << L1->setBits); i++)
     for (int j = 0; j < L1->linesPerSet; j++)
-      if (L1->sets[i].lines[j].valid)
+      if (line_valid(L1, i, j))
         assert(
-            !probe_cache(L1->sets[i].lines[j].block_addr, L2) &&
+            !probe_cache(line_block(L1, i, j), L2) &&
             "Exclusive Property Violation: L1 Cache Block found in L2 Cache.");
 }
 
 // get the input from the file and call operateCache function to see if the
 // address is in the cache.
 void runTrace(char *traceFile, Cache *L1, Cache *L2) {
-  FILE *input = fopen(traceFile, "r");
-  int size;
-  char operation;
-  unsigned long long address;
-  while (fscanf(input, " %c %llx,%d", &operation, &address, &size) == 3) {
+  trace_reader input;
+  trace_record record;
+  trace_open(&input, traceFile);
+  while (trace_next(&input, &record)) {
+    char operation = record.op;
+    unsigned long long address = record.address;
     printf("\n%c %llx,", operation, address);
 
     if (operation != 'M' && operation != 'L' && operation != 'S') {
@@ -72,7 +74,7 @@ void runTrace(char *traceFile, Cache *L1, Cache *L2) {
     // Validate 2-level cache consistency
     validate_2level(L1, L2);
   }
-  fclose(input);
+  trace_close(&input);
 }
 
 int main(int argc, char *argv[]) {
@@ -143,11 +145,20 @@ int main(int argc, char *argv[]) {
   opterr = 0;
   Cache L1;
   L1.lfu = lfu;
+  L1.lfuAging = 0;
+  L1.indexed = 1;
+  L1.hugePages = 0;
+  L1.packed = 0;
   L1.displayTrace = 1;
   // TODO: Initialize L1 cache
 
   Cache L2;
   L2.lfu = lfu;
+  L2.lfuAging = 0;
+  // Back-invalidations flush blocks by address.
+  L2.indexed = 1;
+  L2.hugePages = 0;
+  L2.packed = 0;
   L2.displayTrace = 1;
   // TODO: Initialize L2 cache
   runTrace(traceFile, &L1, &L2);
@@ -0,0 +1,75 @@
+#include "blockindex.h"
+#include "xalloc.h"
+#include <stdlib.h>
+
+static inline bool occupied(const BlockIndex *index, const BlockEntry *entry) {
+  return entry->epoch == index->epoch;
+}
+
+void blockindex_init(BlockIndex *index, size_t blocks) {
+  size_t slots = 16;
+  int bits = 4;
+  while (slots < blocks * 2) {
+    slots <<= 1;
+    bits++;
+  }
+  index->slots = xcalloc(slots, sizeof(BlockEntry));
+  index->mask = slots - 1;
+  index->shift = 64 - bits;
+  index->epoch = 1;
+}
+
+void blockindex_free(BlockIndex *index) {
+  free(index->slots);
+  index->slots = NULL;
+}
+
+void blockindex_clear(BlockIndex *index) {
+  if (++index->epoch != 0)
+    return;
+  // Wrapped around: old slots could look current again.
+  for (size_t i = 0; i <= index->mask; i++)
+    index->slots[i].epoch = 0;
+  index->epoch = 1;
+}
+
+int blockindex_find(const BlockIndex *index, unsigned long long block) {
+  for (size_t i = blockindex_slot(index, block);; i = (i + 1) & index->mask) {
+    const BlockEntry *entry = &index->slots[i];
+    if (!occupied(index, entry))
+      return -1;
+    if (entry->block == block)
+      return entry->way;
+  }
+}
+
+void blockindex_insert(BlockIndex *index, unsigned long long block, int way) {
+  size_t i = blockindex_slot(index, block);
+  while (occupied(index, &index->slots[i]))
+    i = (i + 1) & index->mask;
+  index->slots[i].block = block;
+  index->slots[i].way = way;
+  index->slots[i].epoch = index->epoch;
+}
+
+void blockindex_remove(BlockIndex *index, unsigned long long block) {
+  size_t i = blockindex_slot(index, block);
+  for (;; i = (i + 1) & index->mask) {
+    if (!occupied(index, &index->slots[i]))
+      return;
+    if (index->slots[i].block == block)
+      break;
+  }
+  // Shift later entries of the cluster back into the hole, unless that
+  // would move them in front of their home slot.
+  size_t hole = i;
+  for (size_t j = (i + 1) & index->mask; occupied(index, &index->slots[j]);
+       j = (j + 1) & index->mask) {
+    size_t home = blockindex_slot(index, index->slots[j].block);
+    if (((j - home) & index->mask) >= ((j - hole) & index->mask)) {
+      index->slots[hole] = index->slots[j];
+      hole = j;
+    }
+  }
+  index->slots[hole].epoch = 0;
+}
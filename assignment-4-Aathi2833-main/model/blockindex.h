@@ -0,0 +1,55 @@
+#ifndef BLOCKINDEX_H
+#define BLOCKINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Open-addressing hash map from a resident block address to the way that
+// holds it. The set follows from the block address. Linear probing with
+// backward-shift deletion, so there are no tombstones.
+typedef struct BlockEntry {
+  unsigned long long block;
+  int way;
+  unsigned epoch; // the slot is in use if this is the index's epoch
+} BlockEntry;
+
+typedef struct BlockIndex {
+  BlockEntry *slots;
+  size_t mask;  // slot count - 1, the slot count is a power of two
+  int shift;    // 64 - log2(slot count)
+  unsigned epoch; // current epoch, never 0: 0 marks a freed slot
+} BlockIndex;
+
+// Fibonacci hashing: the top bits of block * 2^64 / phi.
+static inline size_t blockindex_slot(const BlockIndex *index,
+                                     unsigned long long block) {
+  return (size_t)((block * 0x9E3779B97F4A7C15ULL) >> index->shift);
+}
+
+// Start loading the slot where a lookup of the block begins.
+static inline void blockindex_prefetch(const BlockIndex *index,
+                                       unsigned long long block) {
+  __builtin_prefetch(&index->slots[blockindex_slot(index, block)]);
+}
+
+// Size the index for at most `blocks` resident blocks, at a load factor of
+// at most one half.
+void blockindex_init(BlockIndex *index, size_t blocks);
+
+void blockindex_free(BlockIndex *index);
+
+// Way holding the block, or -1.
+int blockindex_find(const BlockIndex *index, unsigned long long block);
+
+// Record that the block now lives in the way. The block must not be
+// indexed already.
+void blockindex_insert(BlockIndex *index, unsigned long long block, int way);
+
+// Forget the block. Does nothing if it is not indexed.
+void blockindex_remove(BlockIndex *index, unsigned long long block);
+
+// Forget every block. Constant time: bumps the epoch, which empties every
+// slot at once.
+void blockindex_clear(BlockIndex *index);
+
+#endif // BLOCKINDEX_H
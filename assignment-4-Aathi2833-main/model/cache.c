@@ -3,10 +3,12 @@
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <immintrin.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 // DO NOT MODIFY THIS FILE. INVOKE AFTER EACH ACCESS FROM runTrace
@@ -21,153 +23,1177 @@ void print_result(result r) {
 }
 
 // HELPER FUNCTIONS USEFUL FOR IMPLEMENTING THE CACHE
+// The masks are derived from setBits and blockBits once, in cacheSetUp.
 // Convert address to block address. 0s out the bottom block bits.
 unsigned long long address_to_block(const unsigned long long address, const Cache *cache) {
-    unsigned long long block_mask = ((unsigned long long)1 << cache->blockBits) - 1;
-    return address & ~block_mask;
-}
-
-// Access the cache after successful probing.
-void access_cache(const unsigned long long address, const Cache *cache) {
-  return;
+    return address & cache->blockMask;
 }
 
 // Calculate the tag of the address. 0s out the bottom set bits and the bottom block bits.
 unsigned long long cache_tag(const unsigned long long address,
                              const Cache *cache) {
-    // Calculate the number of bits for the block and set indices
-    int block_set_bits = cache->blockBits + cache->setBits;
-    
-    // Create a mask to zero out the bottom block and set bits
-    unsigned long long mask = ~(0ULL) << block_set_bits;
-    
-    // Apply the mask to the address to get the tag
-    unsigned long long tag = address & mask;
-
-    return tag;
+    return address & cache->tagAddrMask;
 }
 
-// Calculate the set of the address. 0s out the bottom block bits, 0s out the tag bits, and then shift the set bits to the right.
+// Calculate the set of the address. Shift out the block bits and 0 out the tag bits.
 unsigned long long cache_set(const unsigned long long address, const Cache *cache) {
-    unsigned long long block_mask = ((unsigned long long)1 << cache->blockBits) - 1;
-    unsigned long long set_mask = ((unsigned long long)1 << cache->setBits) - 1;
-    return (address & ~block_mask) >> cache->blockBits & set_mask;
+    return address >> cache->blockBits & cache->setMask;
+}
+
+// Number of 64-bit words in a set's valid bitmap.
+static inline int valid_words(const Cache *cache) {
+    return (cache->linesPerSet + 63) >> 6;
+}
+
+// Find the valid way of the set holding tag, or -1. Only the bits of mask
+// in each tags word are compared. The scalar version only visits valid
+// ways.
+static int match_way_scalar(const Set *set, unsigned long long tag,
+                            unsigned long long mask, int ways) {
+    for (int w = 0; w < ways; w += 64) {
+        unsigned long long bits = set->valid[w >> 6];
+        while (bits) {
+            int i = __builtin_ctzll(bits);
+            if ((set->tags[w + i] & mask) == tag)
+                return w + i;
+            bits &= bits - 1;
+        }
+    }
+    return -1;
+}
+
+// Compare 4 tags per instruction. Reads up to the TAG_STRIDE padding.
+__attribute__((target("avx2")))
+static int match_way_avx2(const Set *set, unsigned long long tag,
+                          unsigned long long mask, int ways) {
+    __m256i key = _mm256_set1_epi64x(tag);
+    __m256i bits = _mm256_set1_epi64x(mask);
+    for (int w = 0; w < ways; w += 64) {
+        unsigned long long valid = set->valid[w >> 6];
+        int n = ways - w < 64 ? ways - w : 64;
+        for (int i = 0; i < n; i += 4) {
+            __m256i tags = _mm256_and_si256(
+                _mm256_load_si256((const __m256i *)(set->tags + w + i)), bits);
+            unsigned long long hits = (unsigned)_mm256_movemask_pd(
+                _mm256_castsi256_pd(_mm256_cmpeq_epi64(tags, key)));
+            hits = (hits << i) & valid;
+            if (hits)
+                return w + __builtin_ctzll(hits);
+        }
+    }
+    return -1;
+}
+
+// Compare 8 tags per instruction. Reads up to the TAG_STRIDE padding.
+__attribute__((target("avx512f")))
+static int match_way_avx512(const Set *set, unsigned long long tag,
+                            unsigned long long mask, int ways) {
+    __m512i key = _mm512_set1_epi64(tag);
+    __m512i bits = _mm512_set1_epi64(mask);
+    for (int w = 0; w < ways; w += 64) {
+        unsigned long long valid = set->valid[w >> 6];
+        int n = ways - w < 64 ? ways - w : 64;
+        for (int i = 0; i < n; i += 8) {
+            __m512i tags = _mm512_and_epi64(
+                _mm512_load_si512((const void *)(set->tags + w + i)), bits);
+            unsigned long long hits =
+                (unsigned long long)_mm512_cmpeq_epi64_mask(tags, key) << i;
+            hits &= valid;
+            if (hits)
+                return w + __builtin_ctzll(hits);
+        }
+    }
+    return -1;
+}
+
+static int (*match_way)(const Set *, unsigned long long, unsigned long long,
+                        int) = match_way_scalar;
+
+// Pick the widest tag comparison this CPU supports, once, at startup.
+__attribute__((constructor))
+static void select_match_way(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        match_way = match_way_avx512;
+    else if (__builtin_cpu_supports("avx2"))
+        match_way = match_way_avx2;
+}
+
+// Find the first invalid way of the set, or -1 if the set is full.
+static int free_way(const Set *set, int ways) {
+    for (int w = 0; w < ways; w += 64) {
+        unsigned long long empty = ~set->valid[w >> 6];
+        if (ways - w < 64)
+            empty &= (1ULL << (ways - w)) - 1;
+        if (empty)
+            return w + __builtin_ctzll(empty);
+    }
+    return -1;
+}
+
+static inline void set_valid(Set *set, int way) {
+    set->valid[way >> 6] |= 1ULL << (way & 63);
+}
+
+static inline void clear_valid(Set *set, int way) {
+    set->valid[way >> 6] &= ~(1ULL << (way & 63));
+}
+
+// Direct-mapped engine: each set is one word, the resident block address
+// with the cache's current mark in its low bits. A word with any other
+// mark, 0 included, is an empty set, so flush_all only changes the mark.
+// A hit is one compare and the victim is the old word.
+static inline unsigned long long *direct_line(unsigned long long address,
+                                              const Cache *cache) {
+    return &cache->direct[address >> cache->blockBits & cache->setMask];
+}
+
+static inline bool direct_valid(unsigned long long word, const Cache *cache) {
+    return (word & ~cache->blockMask) == cache->directMark;
+}
+
+// Sets are emptied lazily by flush_all: a set whose epoch is behind the
+// cache's holds nothing, and is reset when it is next changed.
+static inline bool set_current(const Set *set, const Cache *cache) {
+    return set->epoch == cache->epoch;
+}
+
+static void reset_set(Set *set, Cache *cache) {
+    memset(set->valid, 0, valid_words(cache) * sizeof(unsigned long long));
+    set->mru = set->lru = -1;
+    set->minBucket = -1;
+    set->freeBucket = -1;
+    set->freshBucket = 0;
+    set->accesses = 0;
+    if (cache->freeWays) {
+        cache->freeCount = 0;
+        cache->freshWay = 0;
+    }
+    set->epoch = cache->epoch;
+}
+
+// The set, made current, for a caller that is about to change it.
+static inline Set *use_set(unsigned long long set_index, Cache *cache) {
+    Set *set = &cache->sets[set_index];
+    if (__builtin_expect(!set_current(set, cache), 0))
+        reset_set(set, cache);
+    return set;
+}
+
+bool line_valid(const Cache *cache, int set, int way) {
+    if (cache->direct)
+        return direct_valid(cache->direct[set], cache);
+    const Set *s = &cache->sets[set];
+    return set_current(s, cache) && ((s->valid[way >> 6] >> (way & 63)) & 1);
+}
+
+// Block address held by a way: its tag with the set index put back.
+static inline unsigned long long way_block(const Cache *cache, const Set *set,
+                                           unsigned long long set_index,
+                                           int way) {
+    return (set->tags[way] & cache->tagMask) | set_index << cache->blockBits;
+}
+
+unsigned long long line_block(const Cache *cache, int set, int way) {
+    if (cache->direct)
+        return cache->direct[set] & cache->blockMask;
+    return way_block(cache, &cache->sets[set], set, way);
 }
 
 // Check if the address is found in the cache. If so, return true. else return false.
 bool probe_cache(const unsigned long long address, const Cache *cache) {
-    unsigned long long set_index = cache_set(address, cache);
-    unsigned long long tag = cache_tag(address, cache);
-    for (int i = 0; i < cache->linesPerSet; i++) {
-        if (cache->sets[set_index].lines[i].valid && cache->sets[set_index].lines[i].tag == tag) {
-            return true; // Cache hit
+    return find_block_index(cache_tag(address, cache),
+                            cache_set(address, cache), cache) >= 0;
+}
+
+// Unlink a way from the set's recency list.
+static inline void lru_unlink(Set *set, int way) {
+    Line *lines = set->lines;
+    int prev = lines[way].prev, next = lines[way].next;
+    if (prev >= 0)
+        lines[prev].next = next;
+    else
+        set->mru = next;
+    if (next >= 0)
+        lines[next].prev = prev;
+    else
+        set->lru = prev;
+}
+
+// Make a way the most recently used one.
+static inline void lru_push(Set *set, int way) {
+    Line *lines = set->lines;
+    lines[way].prev = -1;
+    lines[way].next = set->mru;
+    if (set->mru >= 0)
+        lines[set->mru].prev = way;
+    else
+        set->lru = way;
+    set->mru = way;
+}
+
+// Move a valid way to the head of the recency list.
+static inline void lru_touch(Set *set, int way) {
+    if (set->mru != way) {
+        lru_unlink(set, way);
+        lru_push(set, way);
+    }
+}
+
+// Packed mode keeps the recency list in the state bits of the tag words:
+// bits 8-15 hold the previous way and bits 0-7 the next one. With up to
+// 256 ways there is no spare value for an end marker, so set->mru and
+// set->lru mark the ends and the links pointing past them are never read.
+static inline int packed_prev(const Set *set, int way) {
+    return (set->tags[way] >> 8) & 0xff;
+}
+
+static inline int packed_next(const Set *set, int way) {
+    return set->tags[way] & 0xff;
+}
+
+static inline void packed_set_prev(Set *set, int way, int prev) {
+    set->tags[way] = (set->tags[way] & ~0xff00ULL) |
+                     (unsigned long long)prev << 8;
+}
+
+static inline void packed_set_next(Set *set, int way, int next) {
+    set->tags[way] = (set->tags[way] & ~0xffULL) | (unsigned long long)next;
+}
+
+static inline void packed_unlink(Set *set, int way) {
+    if (way == set->mru && way == set->lru) {
+        set->mru = set->lru = -1;
+    } else if (way == set->mru) {
+        set->mru = packed_next(set, way);
+    } else if (way == set->lru) {
+        set->lru = packed_prev(set, way);
+    } else {
+        int prev = packed_prev(set, way), next = packed_next(set, way);
+        packed_set_next(set, prev, next);
+        packed_set_prev(set, next, prev);
+    }
+}
+
+static inline void packed_push(Set *set, int way) {
+    if (set->mru >= 0) {
+        packed_set_prev(set, set->mru, way);
+        packed_set_next(set, way, set->mru);
+    } else {
+        set->lru = way;
+    }
+    set->mru = way;
+}
+
+static inline void packed_touch(Set *set, int way) {
+    if (set->mru != way) {
+        packed_unlink(set, way);
+        packed_push(set, way);
+    }
+}
+
+// LFU keeps the ways of a set in frequency buckets, the O(1) LFU
+// construction: a hit moves the way to the bucket for count + 1, creating it
+// next to the current one if needed, and the victim is the least recently
+// used way of the lowest bucket.
+
+// Buckets come from the free list, or past the high-water mark freshBucket
+// when it is empty, so an emptied set needs no free list rebuilt.
+static inline int bucket_alloc(Set *set, int count) {
+    int b = set->freeBucket;
+    if (b >= 0)
+        set->freeBucket = set->buckets[b].next;
+    else
+        b = set->freshBucket++;
+    set->buckets[b].count = count;
+    set->buckets[b].mru = set->buckets[b].lru = -1;
+    return b;
+}
+
+// Link a new bucket into the count chain after prev (-1: at the front).
+static inline void bucket_link(Set *set, int b, int prev) {
+    FreqBucket *buckets = set->buckets;
+    int next = prev >= 0 ? buckets[prev].next : set->minBucket;
+    buckets[b].prev = prev;
+    buckets[b].next = next;
+    if (prev >= 0)
+        buckets[prev].next = b;
+    else
+        set->minBucket = b;
+    if (next >= 0)
+        buckets[next].prev = b;
+}
+
+// Unlink an empty bucket and return it to the free list.
+static inline void bucket_free(Set *set, int b) {
+    FreqBucket *buckets = set->buckets;
+    int prev = buckets[b].prev, next = buckets[b].next;
+    if (prev >= 0)
+        buckets[prev].next = next;
+    else
+        set->minBucket = next;
+    if (next >= 0)
+        buckets[next].prev = prev;
+    buckets[b].next = set->freeBucket;
+    set->freeBucket = b;
+}
+
+// Make a way the most recently used one of a bucket.
+static inline void bucket_push(Set *set, int b, int way) {
+    Line *lines = set->lines;
+    FreqBucket *bucket = &set->buckets[b];
+    lines[way].bucket = b;
+    lines[way].prev = -1;
+    lines[way].next = bucket->mru;
+    if (bucket->mru >= 0)
+        lines[bucket->mru].prev = way;
+    else
+        bucket->lru = way;
+    bucket->mru = way;
+}
+
+// Take a way out of its bucket. Returns true if the bucket is now empty.
+static inline bool bucket_unlink(Set *set, int way) {
+    Line *lines = set->lines;
+    FreqBucket *bucket = &set->buckets[lines[way].bucket];
+    int prev = lines[way].prev, next = lines[way].next;
+    if (prev >= 0)
+        lines[prev].next = next;
+    else
+        bucket->mru = next;
+    if (next >= 0)
+        lines[next].prev = prev;
+    else
+        bucket->lru = prev;
+    return bucket->mru < 0;
+}
+
+static inline void lfu_insert(Set *set, int way) {
+    int b = set->minBucket;
+    if (b < 0 || set->buckets[b].count != 1) {
+        b = bucket_alloc(set, 1);
+        bucket_link(set, b, -1);
+    }
+    set->lines[way].r_rate = 1;
+    bucket_push(set, b, way);
+}
+
+static inline void lfu_remove(Set *set, int way) {
+    int b = set->lines[way].bucket;
+    if (bucket_unlink(set, way))
+        bucket_free(set, b);
+}
+
+static inline void lfu_hit(Set *set, int way) {
+    FreqBucket *buckets = set->buckets;
+    int b = set->lines[way].bucket;
+    int count = ++set->lines[way].r_rate;
+    int next = buckets[b].next;
+    if (buckets[b].mru == way && buckets[b].lru == way &&
+        (next < 0 || buckets[next].count != count)) {
+        // Sole way of its bucket: bump the bucket in place.
+        buckets[b].count = count;
+        return;
+    }
+    if (next < 0 || buckets[next].count != count) {
+        next = bucket_alloc(set, count);
+        bucket_link(set, next, b);
+    }
+    if (bucket_unlink(set, way))
+        bucket_free(set, b);
+    bucket_push(set, next, way);
+}
+
+// Halve every count of the set. Counts stay at least 1, and as halving
+// keeps their order, buckets that end up with the same count are merged
+// in place, ways of the lower bucket ranking as less recently used.
+static void lfu_age(Set *set) {
+    FreqBucket *buckets = set->buckets;
+    Line *lines = set->lines;
+    int b = set->minBucket;
+    while (b >= 0) {
+        int count = buckets[b].count >> 1;
+        buckets[b].count = count > 0 ? count : 1;
+        for (int way = buckets[b].mru; way >= 0; way = lines[way].next)
+            lines[way].r_rate = buckets[b].count;
+        int prev = buckets[b].prev;
+        if (prev >= 0 && buckets[prev].count == buckets[b].count) {
+            // Append prev's ways behind b's, then drop prev.
+            for (int way = buckets[prev].mru; way >= 0; way = lines[way].next)
+                lines[way].bucket = b;
+            lines[buckets[prev].mru].prev = buckets[b].lru;
+            lines[buckets[b].lru].next = buckets[prev].mru;
+            buckets[b].lru = buckets[prev].lru;
+            buckets[prev].mru = -1;
+            bucket_free(set, prev);
         }
+        b = buckets[b].next;
+    }
+}
+
+// The policy_* functions take the policy as a parameter: the generic entry
+// points pass cache->policy, the access kernels a constant, so each kernel
+// only keeps the code of its own policy. FIFO is LRU without the update on
+// a hit, and the packed layout keeps the same list in the tag words.
+
+// Way of the set to replace when it is full.
+static inline int victim_way(const Set *set, int policy) {
+    if (policy == POLICY_NONE)
+        return 0;
+    if (policy == POLICY_LFU)
+        return set->buckets[set->minBucket].lru;
+    return set->lru;
+}
+
+// Count an access to the set, aging LFU counts when due.
+static inline void policy_access(Set *set, int policy, const Cache *cache) {
+    if (policy == POLICY_LFU && cache->lfuAging > 0 &&
+        ++set->accesses >= cache->lfuAging) {
+        set->accesses = 0;
+        lfu_age(set);
+    }
+}
+
+// Update the replacement state after a hit on a way.
+static inline void policy_hit(Set *set, int way, int policy,
+                              const Cache *cache) {
+    if (policy == POLICY_LFU)
+        lfu_hit(set, way);
+    else if (policy != POLICY_LRU)
+        return;
+    else if (cache->packed)
+        packed_touch(set, way);
+    else
+        lru_touch(set, way);
+}
+
+// Update the replacement state after a block was put into a way. The way
+// was either free or the victim, which stays linked while it is reused.
+static inline void policy_insert(Set *set, int way, bool replaced, int policy,
+                                 const Cache *cache) {
+    if (policy == POLICY_NONE)
+        return;
+    if (policy == POLICY_LFU) {
+        if (replaced)
+            lfu_remove(set, way);
+        lfu_insert(set, way);
+    } else if (cache->packed) {
+        if (replaced)
+            packed_touch(set, way);
+        else
+            packed_push(set, way);
+    } else if (replaced) {
+        lru_touch(set, way);
+    } else {
+        lru_push(set, way);
     }
-    return false; // Cache miss
+}
+
+// Update the replacement state after a way was invalidated.
+static inline void policy_remove(Set *set, int way, int policy,
+                                 const Cache *cache) {
+    if (policy == POLICY_NONE)
+        return;
+    if (policy == POLICY_LFU)
+        lfu_remove(set, way);
+    else if (cache->packed)
+        packed_unlink(set, way);
+    else
+        lru_unlink(set, way);
+}
+
+// Access the cache after successful probing.
+void access_cache(const unsigned long long address, const Cache *cache) {
+    if (cache->direct)
+        return;
+    unsigned long long set_index = cache_set(address, cache);
+    Set *set = &cache->sets[set_index];
+    if (!set_current(set, cache))
+        return;
+    int way = find_block_index(cache_tag(address, cache), set_index, cache);
+    if (way >= 0) {
+        policy_access(set, cache->policy, cache);
+        policy_hit(set, way, cache->policy, cache);
+    }
+}
+
+// The fully associative engine keeps its freed ways on a stack instead of
+// scanning the valid bitmap; ways at or past freshWay were never used since
+// the set was emptied. Take a free way, or -1 if the set is full.
+static inline int take_free_way(Cache *cache, const Set *set) {
+    if (cache->freeWays) {
+        if (cache->freeCount > 0)
+            return cache->freeWays[--cache->freeCount];
+        return cache->freshWay < cache->linesPerSet ? cache->freshWay++ : -1;
+    }
+    return free_way(set, cache->linesPerSet);
+}
+
+// Put the block into the given way of the set. A replaced victim leaves
+// the block index. Packed state bits are kept, the victim is still linked.
+static inline void install_way(Cache *cache, Set *set, int way,
+                               unsigned long long tag,
+                               unsigned long long block, bool replaced) {
+    if (cache->blocks.slots) {
+        if (replaced)
+            blockindex_remove(&cache->blocks,
+                              way_block(cache, set, set - cache->sets, way));
+        blockindex_insert(&cache->blocks, block, way);
+    }
+    set_valid(set, way);
+    set->tags[way] = tag | (set->tags[way] & ~cache->tagMask);
+}
+
+// Drop the block held by a valid way.
+static inline void invalidate_way(Cache *cache, Set *set, int way) {
+    if (cache->blocks.slots)
+        blockindex_remove(&cache->blocks,
+                          way_block(cache, set, set - cache->sets, way));
+    clear_valid(set, way);
+    policy_remove(set, way, cache->policy, cache);
+    if (cache->freeWays)
+        cache->freeWays[cache->freeCount++] = way;
 }
 
 // Allocate an entry for the address. If the cache is full, evict an entry to create space. This method will not fail. When method runs there should have already been space created. 
 void allocate_cache(const unsigned long long address, Cache *cache) {
+    if (cache->direct) {
+        *direct_line(address, cache) =
+            address_to_block(address, cache) | cache->directMark;
+        return;
+    }
     unsigned long long set_index = cache_set(address, cache);
-    unsigned long long tag = cache_tag(address, cache);
-    for (int i = 0; i < cache->linesPerSet; i++) {
-        if (!cache->sets[set_index].lines[i].valid) {
-            // Cache line is empty, insert block
-            cache->sets[set_index].lines[i].valid = 1;
-            cache->sets[set_index].lines[i].tag = tag;
-            return;
-        }
+    Set *set = use_set(set_index, cache);
+    policy_access(set, cache->policy, cache);
+    int way = take_free_way(cache, set);
+    bool replaced = way < 0;
+    if (replaced) {
+        // No empty line found, replace the victim
+        way = victim_way(set, cache->policy);
     }
-    // No empty line found, evict and insert block
-    int victim_line = victim_cache(address, cache);
-    cache->sets[set_index].lines[victim_line].tag = tag;
+    install_way(cache, set, way, cache_tag(address, cache),
+                address_to_block(address, cache), replaced);
+    policy_insert(set, way, replaced, cache->policy, cache);
 }
 
 // Is there space available in the set corresponding to the address?
 bool avail_cache(const unsigned long long address, const Cache *cache) {
+    if (cache->direct)
+        return !direct_valid(*direct_line(address, cache), cache);
     unsigned long long set_index = cache_set(address, cache);
-    for (int i = 0; i < cache->linesPerSet; i++) {
-        if (!cache->sets[set_index].lines[i].valid) {
-            return true; // Empty way available
-        }
-    }
-    return false; // No empty way available
+    if (!set_current(&cache->sets[set_index], cache))
+        return true;
+    if (cache->freeWays)
+        return cache->freeCount > 0 || cache->freshWay < cache->linesPerSet;
+    return free_way(&cache->sets[set_index], cache->linesPerSet) >= 0;
 }
 
 // If the cache is full, evict an entry to create space. This method figures out which entry to evict. Depends on the policy.
 unsigned long long victim_cache(const unsigned long long address, Cache *cache) {
     unsigned long long set_index = cache_set(address, cache);
-    int min_r_rate = cache->sets[set_index].lines[0].r_rate;
-    int victim_index = 0;
-    for (int i = 1; i < cache->linesPerSet; i++) {
-        if (cache->sets[set_index].lines[i].r_rate < min_r_rate) {
-            min_r_rate = cache->sets[set_index].lines[i].r_rate;
-            victim_index = i;
-        }
-    }
-    return victim_index; // Return the way of the block (corresponding line index within the set)
+    if (cache->direct)
+        return 0;
+    // Return the way of the block (corresponding line index within the set)
+    return victim_way(use_set(set_index, cache), cache->policy);
 }
 
 // Set can be determined by the address. Way is determined by policy and set by the operate cache. 
 void evict_cache(const unsigned long long address, int index, Cache *cache) {
+    if (cache->direct) {
+        if (index == 0)
+            *direct_line(address, cache) = 0;
+        return;
+    }
     unsigned long long set_index = cache_set(address, cache);
-    cache->sets[set_index].lines[index].valid = 0;
+    if (index >= 0 && line_valid(cache, set_index, index))
+        invalidate_way(cache, &cache->sets[set_index], index);
 }
 
 
+// Find the way of the set holding the block with this tag. Constant time
+// with the block index, otherwise one pass over the set's tags.
+int find_block_index(unsigned long long tag, unsigned long long set,
+                     const Cache *cache) {
+    unsigned long long block = tag | set << cache->blockBits;
+    if (cache->direct)
+        return cache->direct[set] == (block | cache->directMark) ? 0 : -1;
+    if (cache->blocks.slots)
+        return blockindex_find(&cache->blocks, block);
+    if (!set_current(&cache->sets[set], cache))
+        return -1;
+    return match_way(&cache->sets[set], tag, cache->tagMask,
+                     cache->linesPerSet);
+}
+
 // Given a block address, find it in the cache and when found remove it.
 // If not found don't remove it. Useful when implementing 2-level policies. 
 // and triggering evictions from other caches. 
 void flush_cache(const unsigned long long block_address, Cache *cache) {
-    unsigned long long set_index;
-    unsigned long long tag;
-    
-    // Iterate over all sets to find the block address
+    unsigned long long set_index = cache_set(block_address, cache);
+    int way = find_block_index(cache_tag(block_address, cache), set_index,
+                               cache);
+    if (way >= 0 && cache->direct)
+        cache->direct[set_index] = 0;
+    else if (way >= 0)
+        invalidate_way(cache, &cache->sets[set_index], way);
+}
+
+// Evict every block overlapping [start, end). Short ranges flush block by
+// block; ranges with more blocks than the cache has lines scan the cache.
+void flush_range(const unsigned long long start, const unsigned long long end,
+                 Cache *cache) {
+    unsigned long long first = address_to_block(start, cache);
+    if (end <= first)
+        return;
+    unsigned long long block_size = 1ULL << cache->blockBits;
+    unsigned long long blocks = (end - first - 1) / block_size + 1;
+    unsigned long long lines =
+        (unsigned long long)cache->linesPerSet << cache->setBits;
+    if (blocks <= lines) {
+        for (unsigned long long block = first; blocks--; block += block_size)
+            flush_cache(block, cache);
+        return;
+    }
     for (int i = 0; i < (1 << cache->setBits); i++) {
-        set_index = i;
-        for (int j = 0; j < cache->linesPerSet; j++) {
-            tag = cache->sets[set_index].lines[j].tag;
-            unsigned long long address = (tag << (cache->setBits + cache->blockBits)) | (set_index << cache->blockBits);
-            if (address == block_address) {
-                // Found the block address, invalidate it
-                cache->sets[set_index].lines[j].valid = 0;
-                return;
+        if (cache->direct) {
+            unsigned long long block = cache->direct[i] & cache->blockMask;
+            if (direct_valid(cache->direct[i], cache) && block >= first &&
+                block < end)
+                cache->direct[i] = 0;
+            continue;
+        }
+        Set *set = &cache->sets[i];
+        if (!set_current(set, cache))
+            continue;
+        for (int w = 0; w < cache->linesPerSet; w += 64) {
+            unsigned long long bits = set->valid[w >> 6];
+            while (bits) {
+                int way = w + __builtin_ctzll(bits);
+                unsigned long long block = way_block(cache, set, i, way);
+                if (block >= first && block < end)
+                    invalidate_way(cache, set, way);
+                bits &= bits - 1;
             }
         }
     }
 }
-// checks if the address is in the cache, if not and if the cache is full
-// evicts an address
-result operateCache(const unsigned long long address, Cache *cache) {
+
+// Evict every block in constant time. The direct-mapped engine moves to a
+// new mark, the sets layout to a new epoch, and the block index to a new
+// epoch of its own. Marks and epochs are reused after they run out, which
+// costs one real clear every 2^b - 1 or 2^32 flushes.
+void flush_all(Cache *cache) {
+    if (cache->direct) {
+        if (++cache->directMark > ~cache->blockMask) {
+            memset(cache->direct, 0,
+                   sizeof(unsigned long long) << cache->setBits);
+            cache->directMark = 1;
+        }
+        return;
+    }
+    if (cache->blocks.slots)
+        blockindex_clear(&cache->blocks);
+    if (++cache->epoch == 0)
+        for (int i = 0; i < (1 << cache->setBits); i++)
+            reset_set(&cache->sets[i], cache);
+}
+
+// Walk the valid ways of a current set in replacement order: recency (or
+// insertion) order for LRU and FIFO, and for LFU bucket by bucket from the
+// lowest count, each bucket in recency order. Two sets that give the same
+// blocks, and for LFU the same counts, in this order behave the same from
+// then on, whichever ways the blocks sit in.
+static int walk_first(const Cache *cache, const Set *set, int *bucket) {
+    if (cache->policy == POLICY_NONE)
+        return set->valid[0] & 1 ? 0 : -1;
+    if (cache->policy != POLICY_LFU)
+        return set->mru;
+    *bucket = set->minBucket;
+    return *bucket >= 0 ? set->buckets[*bucket].mru : -1;
+}
+
+static int walk_next(const Cache *cache, const Set *set, int way,
+                     int *bucket) {
+    if (cache->policy == POLICY_NONE)
+        return -1;
+    if (cache->packed)
+        return way == set->lru ? -1 : packed_next(set, way);
+    int next = set->lines[way].next;
+    if (next >= 0 || cache->policy != POLICY_LFU)
+        return next;
+    *bucket = set->buckets[*bucket].next;
+    return *bucket >= 0 ? set->buckets[*bucket].mru : -1;
+}
+
+bool same_set(const Cache *a, const Cache *b, int set) {
+    if (a->direct) {
+        unsigned long long wa = a->direct[set], wb = b->direct[set];
+        bool va = direct_valid(wa, a), vb = direct_valid(wb, b);
+        return va == vb &&
+               (!va || (wa & a->blockMask) == (wb & b->blockMask));
+    }
+    const Set *sa = &a->sets[set], *sb = &b->sets[set];
+    bool ca = set_current(sa, a), cb = set_current(sb, b);
+    if (a->policy == POLICY_LFU && a->lfuAging > 0 &&
+        (ca ? sa->accesses : 0) != (cb ? sb->accesses : 0))
+        return false;
+    int ba = -1, bb = -1;
+    int wa = ca ? walk_first(a, sa, &ba) : -1;
+    int wb = cb ? walk_first(b, sb, &bb) : -1;
+    while (wa >= 0 && wb >= 0) {
+        if (way_block(a, sa, set, wa) != way_block(b, sb, set, wb))
+            return false;
+        if (a->policy == POLICY_LFU &&
+            sa->lines[wa].r_rate != sb->lines[wb].r_rate)
+            return false;
+        wa = walk_next(a, sa, wa, &ba);
+        wb = walk_next(b, sb, wb, &bb);
+    }
+    return wa == wb;
+}
+
+// Add the valid ways of a current set to the block index, or take them
+// out of it.
+static void index_set(Cache *cache, const Set *set, int set_index,
+                      bool insert) {
+    for (int w = 0; w < cache->linesPerSet; w += 64) {
+        unsigned long long bits = set->valid[w >> 6];
+        while (bits) {
+            int way = w + __builtin_ctzll(bits);
+            unsigned long long block = way_block(cache, set, set_index, way);
+            if (insert)
+                blockindex_insert(&cache->blocks, block, way);
+            else
+                blockindex_remove(&cache->blocks, block);
+            bits &= bits - 1;
+        }
+    }
+}
+
+void copy_set(Cache *dst, const Cache *src, int set) {
+    if (dst->direct) {
+        unsigned long long word = src->direct[set];
+        dst->direct[set] = direct_valid(word, src)
+                               ? (word & src->blockMask) | dst->directMark
+                               : 0;
+        return;
+    }
+    Set *d = &dst->sets[set];
+    const Set *s = &src->sets[set];
+    int ways = dst->linesPerSet;
+    if (dst->blocks.slots && set_current(d, dst))
+        index_set(dst, d, set, false);
+    if (!set_current(s, src)) {
+        reset_set(d, dst);
+        return;
+    }
+    memcpy(d->tags, s->tags, ways * sizeof(unsigned long long));
+    memcpy(d->valid, s->valid, valid_words(dst) * sizeof(unsigned long long));
+    if (d->lines)
+        memcpy(d->lines, s->lines, ways * sizeof(Line));
+    if (d->buckets)
+        memcpy(d->buckets, s->buckets, ways * sizeof(FreqBucket));
+    d->mru = s->mru;
+    d->lru = s->lru;
+    d->minBucket = s->minBucket;
+    d->freeBucket = s->freeBucket;
+    d->freshBucket = s->freshBucket;
+    d->accesses = s->accesses;
+    d->epoch = dst->epoch;
+    if (dst->freeWays) {
+        memcpy(dst->freeWays, src->freeWays, ways * sizeof(int));
+        dst->freeCount = src->freeCount;
+        dst->freshWay = src->freshWay;
+    }
+    if (dst->blocks.slots)
+        index_set(dst, d, set, true);
+}
+
+void copy_cache(Cache *dst, const Cache *src) {
+    for (int i = 0; i < (1 << dst->setBits); i++)
+        copy_set(dst, src, i);
+}
+
+// Tag compare for a small, fixed number of ways, all in the first valid
+// word. With ways a constant the loop unrolls into straight-line compares.
+static inline __attribute__((always_inline)) int
+match_fixed(const Set *set, unsigned long long tag, unsigned long long mask,
+            int ways) {
+    unsigned hits = 0;
+    for (int i = 0; i < ways; i++)
+        hits |= (unsigned)((set->tags[i] & mask) == tag) << i;
+    hits &= set->valid[0];
+    return hits ? __builtin_ctz(hits) : -1;
+}
+
+static inline __attribute__((always_inline)) int
+free_fixed(const Set *set, int ways) {
+    unsigned empty = ~set->valid[0] & ((1u << ways) - 1);
+    return empty ? __builtin_ctz(empty) : -1;
+}
+
+// Batches look this many records ahead. The Set of a record is fetched
+// 2 * BATCH_AHEAD records early, its tags, valid bits and lines, whose
+// addresses are in the Set, BATCH_AHEAD records early.
+#define BATCH_AHEAD 8
+
+static inline void prefetch_set(unsigned long long address,
+                                const Cache *cache) {
+    if (cache->direct)
+        __builtin_prefetch(direct_line(address, cache));
+    else if (cache->freeWays)
+        blockindex_prefetch(&cache->blocks, address & cache->blockMask);
+    else
+        __builtin_prefetch(&cache->sets[cache_set(address, cache)]);
+}
+
+static inline void prefetch_ways(unsigned long long address,
+                                 const Cache *cache) {
+    if (cache->direct || cache->freeWays)
+        return;
+    const Set *set = &cache->sets[cache_set(address, cache)];
+    __builtin_prefetch(set->tags);
+    __builtin_prefetch(set->valid);
+    if (set->lines)
+        __builtin_prefetch(set->lines);
+}
+
+static inline bool simulated(char op) {
+    return op == 'L' || op == 'S' || op == 'M';
+}
+
+// The loop of every batch kernel. access is a kernel, a constant in each
+// caller, so it is inlined into the loop.
+static inline __attribute__((always_inline)) void
+run_batch(const unsigned long long *addresses, const char *ops, int n,
+          result *results, Cache *cache,
+          result (*access)(const unsigned long long, Cache *)) {
+    int hits = 0, misses = 0, evictions = 0;
+    for (int i = 0; i < n && i < 2 * BATCH_AHEAD; i++)
+        prefetch_set(addresses[i], cache);
+    for (int i = 0; i < n; i++) {
+        if (i + 2 * BATCH_AHEAD < n)
+            prefetch_set(addresses[i + 2 * BATCH_AHEAD], cache);
+        if (i + BATCH_AHEAD < n)
+            prefetch_ways(addresses[i + BATCH_AHEAD], cache);
+        if (ops && !simulated(ops[i]))
+            continue;
+        result r = access(addresses[i], cache);
+        results[i] = r;
+        hits += r.status == CACHE_HIT;
+        misses += r.status != CACHE_HIT;
+        evictions += r.status == CACHE_EVICT;
+        if (ops && ops[i] == 'M')
+            hits++;
+    }
+    cache->hit_count += hits;
+    cache->miss_count += misses;
+    cache->eviction_count += evictions;
+}
+
+// The body of every access kernel. ways is the associativity when it is a
+// compile-time constant (1 to 16) and 0 otherwise; one_set is true for the
+// fully associative engine, which finds blocks through the block index and
+// free ways on the free stack, so no step scans the ways; policy is the
+// policy_enum. Each kernel below passes constants, so the unused branches
+// and loops compile away. Kernels leave the counters to their callers.
+static inline __attribute__((always_inline)) result
+operate_kernel(const unsigned long long address, Cache *cache, const int ways,
+               const bool one_set, const int policy) {
     result r;
-    if (probe_cache(address, cache)) {
+    unsigned long long set_index = one_set ? 0 : cache_set(address, cache);
+    unsigned long long tag = cache_tag(address, cache);
+    Set *set = use_set(set_index, cache);
+    int n = ways ? ways : cache->linesPerSet;
+
+    r.victim_block = 0;
+    r.insert_block = 0;
+    policy_access(set, policy, cache);
+    int way = one_set ? blockindex_find(&cache->blocks,
+                                        address_to_block(address, cache))
+              : ways  ? match_fixed(set, tag, cache->tagMask, ways)
+                      : match_way(set, tag, cache->tagMask, n);
+    if (way >= 0) {
         r.status = CACHE_HIT;
-        cache->hit_count++;
-    } else {
-        r.status = CACHE_MISS;
-        cache->miss_count++;
-        if (!avail_cache(address, cache)) {
-            r.status = CACHE_EVICT;
-            cache->eviction_count++;
-            unsigned long long victim_way = victim_cache(address, cache);
-            evict_cache(address, victim_way, cache);
-        }
-        allocate_cache(address, cache);
+        policy_hit(set, way, policy, cache);
+        return r;
+    }
+
+    r.status = CACHE_MISS;
+    way = one_set ? take_free_way(cache, set)
+          : ways  ? free_fixed(set, ways)
+                  : free_way(set, n);
+    bool replaced = way < 0;
+    if (replaced) {
+        r.status = CACHE_EVICT;
+        way = victim_way(set, policy);
+        r.victim_block = way_block(cache, set, set_index, way);
     }
+    r.insert_block = address_to_block(address, cache);
+    install_way(cache, set, way, tag, r.insert_block, replaced);
+    policy_insert(set, way, replaced, policy, cache);
     return r;
 }
 
+#define KERNEL(name, ways, one_set, policy)                                  \
+    static result name(const unsigned long long address, Cache *cache) {     \
+        return operate_kernel(address, cache, ways, one_set, policy);        \
+    }                                                                        \
+    static void name##_batch(const unsigned long long *addresses,            \
+                             const char *ops, int n, result *results,        \
+                             Cache *cache) {                                 \
+        run_batch(addresses, ops, n, results, cache, name);                  \
+    }
+#define KERNELS(shape, ways, one_set)                                        \
+    KERNEL(operate_##shape##_lru, ways, one_set, POLICY_LRU)                 \
+    KERNEL(operate_##shape##_lfu, ways, one_set, POLICY_LFU)                 \
+    KERNEL(operate_##shape##_fifo, ways, one_set, POLICY_FIFO)
+
+KERNEL(operate_dm, 1, false, POLICY_NONE)
+KERNELS(2way, 2, false)
+KERNELS(4way, 4, false)
+KERNELS(8way, 8, false)
+KERNELS(16way, 16, false)
+KERNELS(fa, 0, true)
+KERNELS(any, 0, false)
+
+typedef result (*kernel_fn)(const unsigned long long, Cache *);
+typedef void (*batch_fn)(const unsigned long long *, const char *, int,
+                         result *, Cache *);
+
+// Direct-mapped kernel: a hit is one compare and the victim is the old
+// word of the set.
+static result operate_direct(const unsigned long long address, Cache *cache) {
+    result r;
+    unsigned long long block = address & cache->blockMask;
+    unsigned long long *line = direct_line(address, cache);
+    unsigned long long old = *line;
+    r.victim_block = 0;
+    r.insert_block = 0;
+    if (old == (block | cache->directMark)) {
+        r.status = CACHE_HIT;
+        return r;
+    }
+    bool valid = direct_valid(old, cache);
+    r.status = valid ? CACHE_EVICT : CACHE_MISS;
+    r.victim_block = valid ? old & cache->blockMask : 0;
+    r.insert_block = block;
+    *line = block | cache->directMark;
+    return r;
+}
+
+static void operate_direct_batch(const unsigned long long *addresses,
+                                 const char *ops, int n, result *results,
+                                 Cache *cache) {
+    run_batch(addresses, ops, n, results, cache, operate_direct);
+}
+
+// Kernels by shape, then by policy (LRU, LFU, FIFO).
+static const kernel_fn kernels[][3] = {
+    {operate_2way_lru, operate_2way_lfu, operate_2way_fifo},
+    {operate_4way_lru, operate_4way_lfu, operate_4way_fifo},
+    {operate_8way_lru, operate_8way_lfu, operate_8way_fifo},
+    {operate_16way_lru, operate_16way_lfu, operate_16way_fifo},
+    {operate_fa_lru, operate_fa_lfu, operate_fa_fifo},
+    {operate_any_lru, operate_any_lfu, operate_any_fifo},
+};
+
+static const batch_fn batch_kernels[][3] = {
+    {operate_2way_lru_batch, operate_2way_lfu_batch, operate_2way_fifo_batch},
+    {operate_4way_lru_batch, operate_4way_lfu_batch, operate_4way_fifo_batch},
+    {operate_8way_lru_batch, operate_8way_lfu_batch, operate_8way_fifo_batch},
+    {operate_16way_lru_batch, operate_16way_lfu_batch,
+     operate_16way_fifo_batch},
+    {operate_fa_lru_batch, operate_fa_lfu_batch, operate_fa_fifo_batch},
+    {operate_any_lru_batch, operate_any_lfu_batch, operate_any_fifo_batch},
+};
+
+// Pick the kernels for the sets layout: row of the kernel tables, or -1
+// for the direct-mapped POLICY_NONE kernel.
+static int kernel_shape(const Cache *cache) {
+    int ways = cache->linesPerSet;
+    if (cache->policy == POLICY_NONE)
+        return -1;
+    if (cache->freeWays)
+        return 4;
+    if (ways <= 16 && (ways & (ways - 1)) == 0)
+        return __builtin_ctz(ways) - 1;
+    return 5;
+}
+
+static void select_kernel(Cache *cache) {
+    int shape = kernel_shape(cache);
+    cache->operate = shape < 0 ? operate_dm : kernels[shape][cache->policy];
+    cache->operateBatch =
+        shape < 0 ? operate_dm_batch : batch_kernels[shape][cache->policy];
+}
+
+// checks if the address is in the cache, if not and if the cache is full
+// evicts an address. Runs the kernel cacheSetUp picked for the cache.
+result operateCache(const unsigned long long address, Cache *cache) {
+    result r = cache->operate(address, cache);
+    cache->hit_count += r.status == CACHE_HIT;
+    cache->miss_count += r.status != CACHE_HIT;
+    cache->eviction_count += r.status == CACHE_EVICT;
+    return r;
+}
+
+void operateCacheBatch(const unsigned long long *addresses, const char *ops,
+                       int n, result *results, Cache *cache) {
+    cache->operateBatch(addresses, ops, n, results, cache);
+}
+
+void operateCacheRange(const unsigned long long *addresses, const char *ops,
+                       size_t n, result *results, Cache *cache) {
+  static __thread result scratch[CACHE_RANGE_CHUNK];
+  for (size_t i = 0; i < n; i += CACHE_RANGE_CHUNK) {
+    int count = n - i < CACHE_RANGE_CHUNK ? n - i : CACHE_RANGE_CHUNK;
+    operateCacheBatch(addresses + i, ops ? ops + i : NULL, count,
+                      results ? results + i : scratch, cache);
+  }
+}
+
 // initialize the cache and allocate space for it
+#define ARENA_ALIGN 64
+// Fully associative caches with more ways than this run on the block index
+// and a free stack; up to this many, comparing all tags is cheaper.
+#define FA_INDEX_WAYS 64
+#define HUGE_PAGE (2UL << 20)
+
+static inline size_t arena_round(size_t bytes, size_t align) {
+    return (bytes + align - 1) & ~(align - 1);
+}
+
+// Map zeroed, page aligned memory for the arena. Explicit huge pages are
+// only available when the administrator reserved them, so fall back to
+// normal pages and ask for transparent huge pages instead.
+static void *arena_map(Cache *cache, size_t *bytes) {
+    void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (cache->hugePages) {
+        size_t huge = arena_round(*bytes, HUGE_PAGE);
+        arena = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena != MAP_FAILED) {
+            *bytes = huge;
+            return arena;
+        }
+    }
+#endif
+    arena = mmap(NULL, *bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        printf("Error allocating cache %s\n", cache->name);
+        exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (*bytes >= HUGE_PAGE)
+        madvise(arena, *bytes, MADV_HUGEPAGE);
+#endif
+    return arena;
+}
+
+// All sets live in one arena: the Set array, then the tags of every set,
+// the valid bitmaps, the lines (none in packed mode), for LFU the
+// frequency buckets and for the fully associative engine the free stack,
+// each array starting on a cache line. The mapping
+// arrives zeroed, so only the list heads need setting up.
+static void setup_sets(Cache *cache) {
+    size_t sets = (size_t)1 << cache->setBits;
+    size_t ways = cache->linesPerSet;
+    size_t padded = arena_round(ways, TAG_STRIDE);
+    size_t words = valid_words(cache);
+    size_t tagsAt = arena_round(sets * sizeof(Set), ARENA_ALIGN);
+    size_t validAt =
+        tagsAt + arena_round(sets * padded * sizeof(unsigned long long),
+                             ARENA_ALIGN);
+    size_t linesAt =
+        validAt + arena_round(sets * words * sizeof(unsigned long long),
+                              ARENA_ALIGN);
+    size_t lineBytes = cache->packed ? 0 : sets * ways * sizeof(Line);
+    size_t bucketsAt = linesAt + arena_round(lineBytes, ARENA_ALIGN);
+    size_t bucketBytes =
+        cache->policy == POLICY_LFU ? sets * ways * sizeof(FreqBucket) : 0;
+    size_t freeAt = bucketsAt + arena_round(bucketBytes, ARENA_ALIGN);
+    bool associative = cache->setBits == 0 && ways > FA_INDEX_WAYS;
+    size_t bytes = freeAt + (associative ? ways * sizeof(int) : 0);
+    bytes = arena_round(bytes, sysconf(_SC_PAGESIZE));
+    char *arena = arena_map(cache, &bytes);
+    cache->arena = arena;
+    cache->arenaSize = bytes;
+
+    cache->sets = (Set *)arena;
+    unsigned long long *tags = (unsigned long long *)(arena + tagsAt);
+    unsigned long long *valid = (unsigned long long *)(arena + validAt);
+    Line *lines = (Line *)(arena + linesAt);
+    FreqBucket *buckets = (FreqBucket *)(arena + bucketsAt);
+    for (size_t i = 0; i < sets; i++) {
+        Set *set = &cache->sets[i];
+        set->tags = tags + i * padded;
+        set->valid = valid + i * words;
+        set->lines = cache->packed ? NULL : lines + i * ways;
+        set->mru = set->lru = -1;
+        set->buckets = NULL;
+        set->minBucket = -1;
+        set->freeBucket = -1;
+        if (cache->policy == POLICY_LFU)
+            set->buckets = buckets + i * ways;
+    }
+    if (associative) {
+        cache->indexed = 1;
+        cache->freeWays = (int *)(arena + freeAt);
+    }
+    if (cache->indexed)
+        blockindex_init(&cache->blocks, sets * ways);
+    select_kernel(cache);
+}
+
+// A direct-mapped cache is one array of words, one per set, and no Set
+// array at all. It needs spare low bits in the block address for the
+// mark; with 1-byte blocks the cache is laid out as sets of one way.
+static void setup_direct(Cache *cache) {
+    size_t bytes = arena_round(sizeof(unsigned long long) << cache->setBits,
+                               sysconf(_SC_PAGESIZE));
+    cache->arena = arena_map(cache, &bytes);
+    cache->arenaSize = bytes;
+    cache->direct = cache->arena;
+    cache->sets = NULL;
+    cache->operate = operate_direct;
+    cache->operateBatch = operate_direct_batch;
+}
+
+void cache_geometry(Cache *cache) {
+    cache->blockMask = ~0ULL << cache->blockBits;
+    cache->setMask = (1ULL << cache->setBits) - 1;
+    cache->tagAddrMask = ~0ULL << (cache->setBits + cache->blockBits);
+    cache->tagMask = ~0ULL;
+}
+
 void cacheSetUp(Cache *cache, char *name) {
     cache->name = name;
-    cache->sets = (Set*)malloc((1 << cache->setBits) * sizeof(Set));
-    for (int i = 0; i < (1 << cache->setBits); i++) {
-        cache->sets[i].lines = (Line*)malloc(cache->linesPerSet * sizeof(Line));
-        for (int j = 0; j < cache->linesPerSet; j++) {
-            cache->sets[i].lines[j].valid = 0;
-            // Initialize other metadata if needed
+    cache->policy = cache->linesPerSet == 1 ? POLICY_NONE : cache->lfu;
+    cache_geometry(cache);
+    if (cache->packed) {
+        if (cache->policy == POLICY_LFU ||
+            cache->linesPerSet > PACKED_MAX_WAYS ||
+            cache->setBits + cache->blockBits < PACKED_STATE_BITS) {
+            printf("Packed cache %s needs LRU or FIFO, at most %d ways and "
+                   "s + b >= %d\n", name, PACKED_MAX_WAYS, PACKED_STATE_BITS);
+            exit(1);
         }
+        cache->tagMask = ~0ULL << PACKED_STATE_BITS;
     }
+    cache->blocks.slots = NULL;
+    cache->direct = NULL;
+    cache->freeWays = NULL;
+    cache->freeCount = 0;
+    cache->freshWay = 0;
+    cache->epoch = 0;
+    cache->directMark = 1;
+    if (cache->linesPerSet == 1 && cache->blockBits > 0)
+        setup_direct(cache);
+    else
+        setup_sets(cache);
   cache->hit_count = 0;
   cache->miss_count = 0;
   cache->eviction_count = 0;
@@ -175,6 +1201,13 @@ void cacheSetUp(Cache *cache, char *name) {
 
 // deallocate memory
 void deallocate(Cache *cache) {
+    if (cache->arena != NULL)
+        munmap(cache->arena, cache->arenaSize);
+    cache->arena = NULL;
+    cache->arenaSize = 0;
+    cache->sets = NULL;
+    if (cache->blocks.slots != NULL)
+        blockindex_free(&cache->blocks);
 }
 
 void printSummary(const Cache *cache) {
@@ -1,6 +1,7 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include "blockindex.h"
 #include "dogfault.h"
 #include <assert.h>
 #include <ctype.h>
@@ -17,21 +18,75 @@ enum status_enum {
   CACHE_EVICT = 2
 };
 
+// Replacement policies. POLICY_NONE is what a direct-mapped cache runs
+// whatever was asked for: its only way is always the victim.
+enum policy_enum {
+  POLICY_LRU = 0,
+  POLICY_LFU = 1,
+  POLICY_FIFO = 2,
+  POLICY_NONE = 3
+};
+
+// Replacement metadata of one way. The tag and valid bit of each way are
+// kept apart in the set's tags array and valid bitmap, and the block
+// address follows from the tag and the set.
 typedef struct Line {
-  unsigned long long block_addr;
-  short valid;
-  unsigned long long tag;
-  // holds the place in used lines
-  // the greater the rate, that much recent it is
+  // LFU: number of accesses to the block, after aging
   int r_rate;
+  // LFU: frequency bucket holding the way
+  int bucket;
+  // neighbours in the set's recency list (LRU) or in the way list of its
+  // frequency bucket (LFU), -1 at either end
+  int prev;
+  int next;
 } Line;
 
+// A group of ways with the same access count, in recency order. Buckets
+// are chained in increasing count order.
+typedef struct FreqBucket {
+  int count;
+  int mru;  // most recently used way with this count
+  int lru;  // least recently used way with this count
+  int prev; // bucket with the next lower count, -1 if none
+  int next; // bucket with the next higher count, -1 if none
+} FreqBucket;
+
+// Tags are stored contiguously so a hit test can compare several ways per
+// SIMD instruction. The array is padded to a multiple of TAG_STRIDE ways
+// and aligned to 64 bytes.
+#define TAG_STRIDE 8
+
+// Packed mode keeps the LRU state of a way in the low PACKED_STATE_BITS of
+// its tag word, which are 0 in any tag once setBits + blockBits reach
+// them, and drops the Line array: 8 bytes and a valid bit per way.
+#define PACKED_STATE_BITS 16
+#define PACKED_MAX_WAYS 256
+
 typedef struct Set {
-  Line *lines;
-  int recentRate;
-  int placementRate;
+  unsigned long long *tags;  // tag of each way
+  unsigned long long *valid; // bit i of word i / 64 is set when way i is valid
+  Line *lines; // NULL in packed mode
+  // Valid ways in recency order: the most recently used way, which heads
+  // the list, and the least recently used one at its tail. -1 when empty.
+  int mru;
+  int lru;
+  // LFU only: one bucket per way at most, the lowest count bucket, a free
+  // list of released buckets chained through next, the first bucket never
+  // handed out, and the number of accesses since counts were last halved.
+  FreqBucket *buckets;
+  int minBucket;
+  int freeBucket;
+  int freshBucket;
+  int accesses;
+  unsigned epoch; // the set is empty unless this is the cache's epoch
 } Set;
 
+typedef struct result {
+  int status;                    // 0: miss 1: hit 2: evict
+  unsigned long long victim_block; // block address of the victime line.
+  unsigned long long insert_block; // block address of inserted line.
+} result;
+
 typedef struct Cache {
   int setBits;
   int linesPerSet;
@@ -41,16 +96,39 @@ typedef struct Cache {
   int hit_count;
   int miss_count;
   short displayTrace;
-  int lfu; // 0: Least Recently Used   1: Least Frequently Used.
+  int lfu; // 0: Least Recently Used   1: Least Frequently Used   2: First In First Out (policy_enum)
+  int lfuAging; // LFU: halve the counts of a set every lfuAging accesses to it, 0: never
+  int indexed; // 1: keep a block -> way index, making flush_cache O(1)
+  int packed; // 1: packed per-way metadata, LRU or FIFO only
+  int hugePages; // 1: try to back the arena with explicit huge pages
+  // Set up by cacheSetUp:
+  BlockIndex blocks; // the index, slots is NULL unless indexed
+  void *arena; // one mapping holding every set, tag, bitmap and line
+  // Direct-mapped caches with blockBits >= 1: one word per set, the block
+  // address | directMark, anything else when empty. sets is NULL then.
+  unsigned long long *direct;
+  unsigned long long directMark; // 1 to 2^blockBits - 1
+  // Fully associative engine (s = 0, many ways): the freed ways as a stack
+  // and the first way not used since the set was emptied; freeWays is NULL
+  // otherwise. The block index is always on for it.
+  int *freeWays;
+  int freeCount;
+  int freshWay;
+  unsigned epoch; // bumped by flush_all, see Set.epoch
+  size_t arenaSize;
+  int policy; // policy_enum actually run
+  unsigned long long blockMask;   // address bits of the block address
+  unsigned long long setMask;     // set index bits, after >> blockBits
+  unsigned long long tagAddrMask; // address bits of the tag
+  unsigned long long tagMask; // bits of a tags word that hold the tag
+  // Access kernels specialised for the shape and policy of the cache, for
+  // one address and for a batch. Neither updates the counters.
+  result (*operate)(const unsigned long long address, struct Cache *cache);
+  void (*operateBatch)(const unsigned long long *addresses, const char *ops,
+                       int n, result *results, struct Cache *cache);
   char* name; 
 } Cache;
 
-typedef struct result {
-  int status;                    // 0: miss 1: hit 2: evict
-  unsigned long long victim_block; // block address of the victime line.
-  unsigned long long insert_block; // block address of inserted line.
-} result;
-
 void print_result(result r);
 
 unsigned long long address_to_block(unsigned long long address,
@@ -85,13 +163,55 @@ void evict_cache(const unsigned long long address, int index, Cache *cache);
 
 // Evict block from cache. Need to find corresponding set and index.
 // Block addresses have bottom blockBits bits set to 0.
-// Essentially block_addr = tag << (setBits + blockBits)
+// Essentially block_addr = tag | set << blockBits
 void flush_cache(const unsigned long long block_addr, Cache *cache);
 
+// Evict every block overlapping the addresses [start, end).
+void flush_range(const unsigned long long start, const unsigned long long end,
+                 Cache *cache);
+
+// Evict every block, in constant time.
+void flush_all(Cache *cache);
+
+// Do two caches of the same geometry and policy hold the same blocks of
+// the set, in the same replacement order (with the same counts for LFU)?
+// Which ways the blocks sit in does not matter: sets that compare equal
+// give the same results for any accesses that follow.
+bool same_set(const Cache *a, const Cache *b, int set);
+
+// Make a set of dst hold what the same set of src holds. Both caches must
+// have been set up with the same geometry and options.
+void copy_set(Cache *dst, const Cache *src, int set);
+
+// copy_set for every set. The counters are left alone.
+void copy_cache(Cache *dst, const Cache *src);
+
 // checks if the address is in the cache, if not and if the cache is full
 // evicts an address
 result operateCache(const unsigned long long address, Cache *cache);
 
+// Simulate n trace records in order, like operateCache on each address.
+// ops[i] is the lackey op of addresses[i]: only L, S and M records are
+// simulated, an M counting one more hit for its store. results[i] gets the
+// result of each simulated record and is left alone for the others. ops
+// may be NULL to simulate every address as a load. Upcoming sets are
+// prefetched while earlier records are simulated, and the counters are
+// updated once, at the end.
+void operateCacheBatch(const unsigned long long *addresses, const char *ops,
+                       int n, result *results, Cache *cache);
+
+#define CACHE_RANGE_CHUNK 4096 // records operateCacheRange batches at once
+
+// operateCacheBatch over any number of records, CACHE_RANGE_CHUNK at a
+// time. results may be NULL to drop the results, which then go to a
+// scratch buffer of the calling thread.
+void operateCacheRange(const unsigned long long *addresses, const char *ops,
+                       size_t n, result *results, Cache *cache);
+
+// Derive the address masks from setBits and blockBits, which is all that
+// address_to_block, cache_tag and cache_set need. cacheSetUp does this too.
+void cache_geometry(Cache *cache);
+
 // initialize the cache
 void cacheSetUp(Cache *cache, char *name);
 
@@ -100,6 +220,12 @@ void deallocate(Cache *cache);
 
 void printSummary(const Cache *cache);
 
-// Function declaration for find_block_index
+// Does the given way of the given set hold a block?
+bool line_valid(const Cache *cache, int set, int way);
+
+// Block address held by a valid way.
+unsigned long long line_block(const Cache *cache, int set, int way);
+
+// Way of the set holding the block with this tag, or -1 if not cached.
 int find_block_index(unsigned long long tag, unsigned long long set, const Cache *cache);
 #endif // CACHE_H
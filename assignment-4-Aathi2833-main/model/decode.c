@@ -0,0 +1,166 @@
+#include "decode.h"
+#include "trace.h"
+#include "xalloc.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One newline-aligned slice of a text trace and what it decoded to.
+typedef struct chunk {
+  const char *start;
+  const char *end;
+  const char *stop;  // where scanning stopped
+  trace_buffer part; // records decoded from this chunk
+  size_t capacity;
+  trace_buffer *out; // concatenation target
+  size_t offset;     // index of part.ops[0] in out
+} chunk;
+
+static void buffer_reserve(trace_buffer *buffer, size_t *capacity,
+                           size_t wanted) {
+  if (wanted <= *capacity)
+    return;
+  size_t grown = *capacity * 2;
+  *capacity = grown > wanted ? grown : wanted;
+  buffer->ops = xrealloc(buffer->ops, *capacity);
+  buffer->addresses =
+      xrealloc(buffer->addresses, *capacity * sizeof(*buffer->addresses));
+  buffer->sizes = xrealloc(buffer->sizes, *capacity * sizeof(*buffer->sizes));
+}
+
+// Decode records from reader until it stops, appending to buffer.
+static void decode_into(trace_reader *reader, trace_buffer *buffer,
+                        size_t *capacity) {
+  trace_record record;
+  while (trace_next(reader, &record)) {
+    if (buffer->count == *capacity)
+      buffer_reserve(buffer, capacity, buffer->count + 1);
+    buffer->ops[buffer->count] = record.op;
+    buffer->addresses[buffer->count] = record.address;
+    buffer->sizes[buffer->count] = record.size;
+    buffer->count++;
+  }
+}
+
+static void *decode_chunk(void *arg) {
+  chunk *c = arg;
+  trace_reader view;
+  trace_slice(&view, c->start, c->end);
+  memset(&c->part, 0, sizeof(c->part));
+  c->capacity = 0;
+  // Lackey lines average well over 8 bytes.
+  buffer_reserve(&c->part, &c->capacity, (c->end - c->start) / 8 + 1);
+  decode_into(&view, &c->part, &c->capacity);
+  c->stop = view.cursor;
+  return NULL;
+}
+
+static void *copy_chunk(void *arg) {
+  chunk *c = arg;
+  memcpy(c->out->ops + c->offset, c->part.ops, c->part.count);
+  memcpy(c->out->addresses + c->offset, c->part.addresses,
+         c->part.count * sizeof(*c->part.addresses));
+  memcpy(c->out->sizes + c->offset, c->part.sizes,
+         c->part.count * sizeof(*c->part.sizes));
+  return NULL;
+}
+
+// Did the chunk scan all the way through, leaving only whitespace?
+static bool chunk_clean(const chunk *c) {
+  for (const char *p = c->stop; p < c->end; p++)
+    if (*p != ' ' && (*p < '\t' || *p > '\r'))
+      return false;
+  return true;
+}
+
+// Run fn over chunks[0..n) with one thread per chunk; chunk 0 runs on the
+// calling thread.
+static void run_chunks(void *(*fn)(void *), chunk *chunks, int n) {
+  pthread_t *threads = xmalloc(n * sizeof(pthread_t));
+  for (int i = 1; i < n; i++)
+    if (pthread_create(&threads[i], NULL, fn, &chunks[i]) != 0) {
+      printf("Error starting trace decoder thread\n");
+      exit(1);
+    }
+  fn(&chunks[0]);
+  for (int i = 1; i < n; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+void trace_decode(const char *traceFile, int threads, trace_buffer *buffer) {
+  trace_reader input;
+  size_t capacity = 0;
+  memset(buffer, 0, sizeof(*buffer));
+  // Building the sidecar would parse the whole text serially first.
+  trace_open_existing(&input, traceFile);
+  if (input.format != TRACE_TEXT || threads <= 1 || input.length == 0) {
+    decode_into(&input, buffer, &capacity);
+    trace_close(&input);
+    return;
+  }
+
+  // Cut the file into roughly equal chunks, each ending after a newline.
+  chunk *chunks = xmalloc(threads * sizeof(chunk));
+  const char *start = input.data;
+  int n = 0;
+  for (int i = 0; i < threads && start < input.end; i++) {
+    const char *end = input.data + input.length / threads * (i + 1);
+    if (i == threads - 1 || end >= input.end) {
+      end = input.end;
+    } else {
+      if (end < start)
+        end = start;
+      const char *newline = memchr(end, '\n', input.end - end);
+      end = newline ? newline + 1 : input.end;
+    }
+    chunks[n].start = start;
+    chunks[n].end = end;
+    n++;
+    start = end;
+  }
+  run_chunks(decode_chunk, chunks, n);
+
+  // A chunk that stopped early hit a malformed record, or a record that
+  // does not fit on one line. Decode serially from that point on, which is
+  // exactly what a single reader would have done, and drop later chunks.
+  size_t total = 0;
+  int used = n;
+  const char *resume = NULL;
+  for (int i = 0; i < n; i++) {
+    chunks[i].out = buffer;
+    chunks[i].offset = total;
+    total += chunks[i].part.count;
+    if (!chunk_clean(&chunks[i])) {
+      used = i + 1;
+      resume = chunks[i].stop;
+      break;
+    }
+  }
+
+  buffer_reserve(buffer, &capacity, total);
+  run_chunks(copy_chunk, chunks, used);
+  buffer->count = total;
+  if (resume != NULL) {
+    trace_reader rest;
+    trace_slice(&rest, resume, input.end);
+    decode_into(&rest, buffer, &capacity);
+  }
+
+  for (int i = 0; i < n; i++) {
+    free(chunks[i].part.ops);
+    free(chunks[i].part.addresses);
+    free(chunks[i].part.sizes);
+  }
+  free(chunks);
+  trace_close(&input);
+}
+
+void trace_buffer_free(trace_buffer *buffer) {
+  free(buffer->ops);
+  free(buffer->addresses);
+  free(buffer->sizes);
+  memset(buffer, 0, sizeof(*buffer));
+}
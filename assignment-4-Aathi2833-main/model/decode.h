@@ -0,0 +1,23 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+
+// A whole trace decoded into dense arrays, in trace order.
+typedef struct trace_buffer {
+  size_t count;
+  char *ops;
+  unsigned long long *addresses;
+  int *sizes;
+} trace_buffer;
+
+// Decode the whole trace. A text trace is split at newline boundaries into
+// one chunk per thread and the chunks are decoded in parallel, then
+// concatenated in order. Binary traces, and text traces with an up to date
+// sidecar, are decoded on the calling thread. No sidecar is built.
+// The result is identical to reading the trace with trace_next.
+void trace_decode(const char *traceFile, int threads, trace_buffer *buffer);
+
+void trace_buffer_free(trace_buffer *buffer);
+
+#endif // DECODE_H
@@ -1,5 +1,17 @@
 #include "dogfault.h"
 #include "cache.h"
+#include "decode.h"
+#include "phase.h"
+#include "pipeline.h"
+#include "reorder.h"
+#include "setsample.h"
+#include "shard.h"
+#include "shards.h"
+#include "stackdist.h"
+#include "sweep.h"
+#include "timeshard.h"
+#include "trace.h"
+#include "xalloc.h"
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -10,57 +22,334 @@
 #include <unistd.h>
 
 
+// Print one trace record and, if it was simulated, its result.
+static void printAccess(char operation, unsigned long long address,
+                        result r, const Cache *cache) {
+  if (cache->displayTrace)
+    printf("\n%c %llx,", operation, address);
+
+  if (operation != 'M' && operation != 'L' && operation != 'S') {
+    return;
+  }
+  if (r.status != CACHE_HIT && r.status != CACHE_MISS &&
+      r.status != CACHE_EVICT)
+    printf("Error: Invalid result from operateCache\n");
+  print_result(r);
+
+  // if (cache->displayTrace)
+  //   printf("\n");
+}
+
+// Simulate one trace record and print its result.
+static void accessTrace(char operation, unsigned long long address,
+                        Cache *cache) {
+  result r = {0, 0, 0};
+  if (operation == 'M' || operation == 'L' || operation == 'S') {
+    // operateCache keeps the hit, miss and eviction counts.
+    r = operateCache(address, cache);
+    if (operation == 'M') {
+      cache->hit_count++;
+    }
+  }
+  printAccess(operation, address, r, cache);
+}
+
+// Simulate a run of trace records with the batch API, then print them.
+static void accessBatch(const char *ops, const unsigned long long *addresses,
+                        int count, result *results, Cache *cache) {
+  operateCacheBatch(addresses, ops, count, results, cache);
+  for (int i = 0; i < count; i++)
+    printAccess(ops[i], addresses[i], results[i], cache);
+}
+
 // get the input from the file and call operateCache function to see if the
 // address is in the cache.
 void runTrace(char *traceFile, Cache *cache) {
-  FILE *input = fopen(traceFile, "r");
-  int size;
-  char operation;
-  result r;
-  unsigned long long address;
-  while (fscanf(input, " %c %llx,%d", &operation, &address, &size) == 3) {
-    if (cache->displayTrace)
-      printf("\n%c %llx,", operation, address);
-
-    if (operation != 'M' && operation != 'L' && operation != 'S') {
+  trace_reader input;
+  trace_record record;
+  trace_open(&input, traceFile);
+  while (trace_next(&input, &record))
+    accessTrace(record.op, record.address, cache);
+  trace_close(&input);
+}
+
+// Same as runTrace, but only about 1 in `ratio` sets is simulated: records
+// to the other sets are dropped once their set is known. Prints the
+// totals scaled up to all sets, with confidence intervals.
+void runTraceSampled(char *traceFile, int ratio, Cache *cache) {
+  set_sample sample;
+  trace_reader input;
+  trace_record record;
+  set_sample_init(&sample, ratio, cache);
+  trace_open(&input, traceFile);
+  while (trace_next(&input, &record)) {
+    if (record.op != 'M' && record.op != 'L' && record.op != 'S')
+      continue;
+    int g = set_sample_group_of(&sample, record.address, cache);
+    if (g < 0) {
+      sample.dropped += 1 + (record.op == 'M');
       continue;
     }
-    r = operateCache(address, cache);
-    switch(r.status) {
-      case CACHE_HIT:
-        cache->hit_count++;
-        break;
-      case CACHE_MISS:
-        cache->miss_count++;
-        break;
-      case CACHE_EVICT:
-        cache->miss_count++;
-        break;
-      default:
-        printf("Error: Invalid result from operateCache\n");
-    }
-    print_result(r);
-    if (operation == 'M') {
-      cache->hit_count++;
-    }
+    int hits = cache->hit_count, misses = cache->miss_count,
+        evictions = cache->eviction_count;
+    accessTrace(record.op, record.address, cache);
+    sample.groups[g].hits += cache->hit_count - hits;
+    sample.groups[g].misses += cache->miss_count - misses;
+    sample.groups[g].evictions += cache->eviction_count - evictions;
+  }
+  trace_close(&input);
+  set_sample_print(&sample, cache);
+  set_sample_free(&sample);
+}
+
+// Same as runTrace, but the trace is decoded on a separate reader thread
+// while this thread simulates.
+void runTracePipelined(char *traceFile, Cache *cache) {
+  pipeline *p;
+  if (posix_memalign((void **)&p, 64, sizeof(pipeline)) != 0) {
+    printf("Error allocating trace pipeline\n");
+    exit(1);
+  }
+  pipeline_start(p, traceFile);
+  static result results[PIPELINE_BATCH];
+  const trace_batch *batch;
+  while ((batch = pipeline_next(p)) != NULL)
+    accessBatch(batch->ops, batch->addresses, batch->count, results, cache);
+  pipeline_finish(p);
+  fprintf(stderr, "pipeline: reader stalled %.3f ms, simulator stalled %.3f ms\n",
+          p->reader_stall * 1e3, p->consumer_stall * 1e3);
+  free(p);
+}
+
+// Decode the whole trace up front on the given number of threads, then
+// simulate it.
+void runTraceDecoded(char *traceFile, int threads, Cache *cache) {
+  static result results[PIPELINE_BATCH];
+  trace_buffer trace;
+  trace_decode(traceFile, threads, &trace);
+  for (size_t i = 0; i < trace.count; i += PIPELINE_BATCH) {
+    int count = trace.count - i < PIPELINE_BATCH ? trace.count - i
+                                                 : PIPELINE_BATCH;
+    accessBatch(trace.ops + i, trace.addresses + i, count, results, cache);
+  }
+  trace_buffer_free(&trace);
+}
+
+// Decode the whole trace, then simulate it a window at a time with the
+// sets split across the given number of threads, printing each window in
+// trace order once it is done.
+void runTraceSharded(char *traceFile, int threads, Cache *cache) {
+  trace_buffer trace;
+  trace_decode(traceFile, threads, &trace);
+  size_t window = trace.count < SHARD_WINDOW ? trace.count : SHARD_WINDOW;
+  result *results = xmalloc(window * sizeof(result));
+  for (size_t i = 0; i < trace.count; i += window) {
+    size_t count = trace.count - i < window ? trace.count - i : window;
+    shard_simulate(trace.ops + i, trace.addresses + i, count, results,
+                   threads, cache);
+    for (size_t j = 0; j < count; j++)
+      printAccess(trace.ops[i + j], trace.addresses[i + j], results[j], cache);
+  }
+  free(results);
+  trace_buffer_free(&trace);
+}
+
+// Decode the whole trace, then simulate it a window at a time with each
+// window cut in time across the given number of threads, printing each
+// window in trace order once it is stitched. Runs past the first warm up
+// on the `warmup` records before them.
+void runTraceTimeSharded(char *traceFile, int threads, size_t warmup,
+                         Cache *cache) {
+  trace_buffer trace;
+  trace_decode(traceFile, threads, &trace);
+  size_t window =
+      trace.count < TIMESHARD_WINDOW ? trace.count : TIMESHARD_WINDOW;
+  result *results = xmalloc(window * sizeof(result));
+  size_t redone = 0;
+  for (size_t i = 0; i < trace.count; i += window) {
+    size_t end = trace.count - i < window ? trace.count : i + window;
+    redone += timeshard_simulate(trace.ops, trace.addresses, i, end, warmup,
+                                 results, threads, cache);
+    for (size_t j = i; j < end; j++)
+      printAccess(trace.ops[j], trace.addresses[j], results[j - i], cache);
+  }
+  fprintf(stderr, "timeshard: %zu of %zu records simulated again\n", redone,
+          trace.count);
+  free(results);
+  trace_buffer_free(&trace);
+}
+
+// Decode the trace, pick its phases from intervals of `interval` records,
+// and simulate one interval per phase, warmed on the `warmup` records
+// before it. Prints the totals of the whole trace estimated from them.
+void runTracePhases(char *traceFile, int threads, size_t interval,
+                    int clusters, size_t warmup, Cache *cache) {
+  trace_buffer trace;
+  phase *phases;
+  if (clusters < 1) {
+    printf("Error: -K needs at least 1 phase\n");
+    exit(1);
+  }
+  trace_decode(traceFile, threads, &trace);
+  int count = phase_select(&trace, interval, clusters, &phases);
+  phase_simulate(&trace, interval, warmup, phases, count, cache);
+  phase_print(phases, count, interval, cache);
+  free(phases);
+  trace_buffer_free(&trace);
+}
+
+// Decode the trace once and simulate every configuration of the grid on
+// it, then print the counts as one table.
+void runSweep(char *traceFile, sweep_grid *grid, int threads,
+              const Cache *cache) {
+  sweep_point *points;
+  trace_buffer trace;
+  sweep_grid_fill(grid, cache);
+  size_t n = sweep_points(grid, &points);
+  trace_decode(traceFile, threads, &trace);
+  sweep_run(&trace, points, n, threads, cache);
+  sweep_print(points, n);
+  free(points);
+  trace_buffer_free(&trace);
+}
+
+// Decode the trace and print the LRU miss ratio of every cache with up to
+// 2^s sets and up to E ways, at the cache's block size.
+void runStackSurface(char *traceFile, int threads, const Cache *cache) {
+  stack_surface surface;
+  trace_buffer trace;
+  if (cache->lfu != POLICY_LRU) {
+    printf("Error: -S computes LRU miss ratios only\n");
+    exit(1);
+  }
+  if (cache->setBits < 0 || cache->linesPerSet < 1 || cache->blockBits < 0 ||
+      cache->setBits + cache->blockBits >= 64) {
+    printf("Error: -S needs -s, -E and -b\n");
+    exit(1);
+  }
+  trace_decode(traceFile, threads, &trace);
+  stack_surface_build(&trace, cache->setBits, cache->linesPerSet,
+                      cache->blockBits, &surface);
+  stack_surface_print(&surface);
+  stack_surface_free(&surface);
+  trace_buffer_free(&trace);
+}
+
+// Stream the trace through a SHARDS sampler, at a fixed rate or within a
+// fixed number of tracked blocks, and print the approximate miss ratio
+// curve of fully associative LRU caches of up to 2^s * E lines.
+void runShards(char *traceFile, double rate, size_t limit,
+               const Cache *cache) {
+  static shards analysis;
+  trace_reader input;
+  trace_record record;
+  int setBits = cache->setBits > 0 ? cache->setBits : 0;
+  if (cache->linesPerSet < 1 || cache->blockBits < 0 || setBits > 30 ||
+      ((long)cache->linesPerSet << setBits) > 0x7fffffff) {
+    printf("Error: -r and -m need -E, -b and at most 2^31 lines\n");
+    exit(1);
+  }
+  if (!limit && (rate <= 0 || rate > 1)) {
+    printf("Error: the -r sampling rate must be in (0, 1]\n");
+    exit(1);
+  }
+  shards_init(&analysis, rate, limit, cache->linesPerSet << setBits,
+              cache->blockBits);
+  trace_open(&input, traceFile);
+  while (trace_next(&input, &record))
+    shards_access(&analysis, record.op, record.address);
+  trace_close(&input);
+  shards_print(&analysis);
+  shards_free(&analysis);
+}
 
-    // if (cache->displayTrace)
-    //   printf("\n");
+// Simulate one window of records set by set, then print it in trace order.
+static void accessReordered(const char *ops, const unsigned long long *addresses,
+                            size_t count, result *results,
+                            reorder_buffer *buffer, Cache *cache) {
+  reorder_simulate(ops, addresses, count, results, buffer, cache);
+  for (size_t i = 0; i < count; i++)
+    printAccess(ops[i], addresses[i], results[i], cache);
+}
+
+// Simulate the trace set by set. With a window of 0 the whole trace is
+// decoded (on the given number of threads) and reordered at once; otherwise
+// it is read and reordered `window` records at a time, so memory stays
+// bounded however long the trace is.
+void runTraceReordered(char *traceFile, int threads, size_t window,
+                       Cache *cache) {
+  static reorder_buffer buffer;
+  trace_buffer trace;
+  bool whole = window == 0;
+  if (whole) {
+    trace_decode(traceFile, threads, &trace);
+    window = trace.count;
+  } else {
+    memset(&trace, 0, sizeof(trace));
+    trace.ops = xmalloc(window);
+    trace.addresses = xmalloc(window * sizeof(*trace.addresses));
+  }
+  result *results = xmalloc(window * sizeof(result));
+  reorder_init(&buffer, window);
+
+  if (whole) {
+    accessReordered(trace.ops, trace.addresses, trace.count, results, &buffer,
+                    cache);
+  } else {
+    trace_reader input;
+    trace_record record;
+    bool more = true;
+    trace_open(&input, traceFile);
+    while (more) {
+      size_t count = 0;
+      while (count < window && (more = trace_next(&input, &record))) {
+        trace.ops[count] = record.op;
+        trace.addresses[count++] = record.address;
+      }
+      accessReordered(trace.ops, trace.addresses, count, results, &buffer,
+                      cache);
+    }
+    trace_close(&input);
   }
-  fclose(input);
+  reorder_free(&buffer);
+  free(results);
+  trace_buffer_free(&trace);
 }
 
 int main(int argc, char *argv[]) {
   Cache cache;
   cache.lfu = 0;
+  cache.lfuAging = 0;
+  cache.indexed = 0;
+  cache.hugePages = 0;
+  cache.packed = 0;
+  cache.setBits = cache.linesPerSet = cache.blockBits = -1;
   opterr = 0;
   cache.displayTrace = 0;
   int option = 0;
-  char *traceFile;
+  int pipelined = 0;
+  int decodeThreads = 0;
+  int simulateThreads = 0;
+  int reordered = 0;
+  int timeThreads = 0;
+  long warmup = -1;
+  sweep_grid grid;
+  int sweeping = 0;
+  int surface = 0;
+  int shardsMode = 0; // 'r' or 'm', whichever came last
+  double shardsRate = 0;
+  long shardsLimit = 0;
+  int sampleRatio = 0;
+  long phaseInterval = 0;
+  int phaseClusters = PHASE_CLUSTERS;
+  int clustered = 0; // -K given
+  memset(&grid, 0, sizeof(grid));
+  size_t window = 0;
+  char *traceFile = NULL;
   // accepting command-line options
   // "assistance from"
   // https://www.gnu.org/software/libc/manual/html_node/Example-of-Getopt.html#Example-of-Getopt
-  while ((option = getopt(argc, argv, "s:E:b:t:LFv")) != -1) {
+  while ((option = getopt(argc, argv, "s:E:b:t:LFfa:iHPvpD:j:RW:T:w:G:g:Sr:m:k:I:K:")) != -1) {
     switch (option) {
     // select the number of set bits (i.e., use S = 2s sets)
     case 's':
@@ -80,32 +369,208 @@ int main(int argc, char *argv[]) {
     case 'v':
       cache.displayTrace = 1;
       break;
+    case 'p':
+      pipelined = 1;
+      break;
+    case 'D':
+      decodeThreads = atoi(optarg);
+      break;
+    case 'j':
+      simulateThreads = atoi(optarg);
+      break;
+    case 'T':
+      timeThreads = atoi(optarg);
+      break;
+    case 'w':
+      warmup = atol(optarg);
+      break;
+    case 'G':
+      sweeping = 1;
+      sweep_grid_parse(&grid, optarg);
+      break;
+    case 'g':
+      sweeping = 1;
+      sweep_grid_load(&grid, optarg);
+      break;
+    case 'S':
+      surface = 1;
+      break;
+    case 'r':
+      shardsMode = option;
+      shardsRate = atof(optarg);
+      break;
+    case 'm':
+      shardsMode = option;
+      shardsLimit = atol(optarg);
+      break;
+    case 'k':
+      sampleRatio = atoi(optarg);
+      break;
+    case 'I':
+      phaseInterval = atol(optarg);
+      break;
+    case 'K':
+      clustered = 1;
+      phaseClusters = atoi(optarg);
+      break;
+    case 'R':
+      reordered = 1;
+      break;
+    case 'W':
+      reordered = 1;
+      window = strtoull(optarg, NULL, 10);
+      break;
     case 'L':
       cache.lfu = 0;
       break;
     case 'F':
       cache.lfu = 1;
       break;
+    case 'f':
+      cache.lfu = POLICY_FIFO;
+      break;
+    case 'a':
+      cache.lfuAging = atoi(optarg);
+      break;
+    case 'i':
+      cache.indexed = 1;
+      break;
+    case 'H':
+      cache.hugePages = 1;
+      break;
+    case 'P':
+      cache.packed = 1;
+      break;
     case 'h':
     default:
       printf("Usage: \n\
-      ./ cache [-hv] - s<num> -E<num> -b<num> -t<file> (-L | -F) \n\
+      ./ cache [-hvpiHPRS] - s<num> -E<num> -b<num> -t<file> (-L | -F | -f) [-a<num>] [-D<num>] [-j<num>] [-W<num>] [-T<num> [-w<num>]] [-G<grid>] [-g<file>] \n\
+      [-r<rate> | -m<num>] [-k<num>] [-I<num> [-K<num>] [-w<num>]] \n\
       Options : \n\
           -h Print this help message. \n\
           -v Optional verbose flag. \n\
+          -p Decode the trace on a separate thread. \n\
+          -i Keep a block index for constant time flushes. \n\
+          -H Back the cache with huge pages when they are reserved. \n\
+          -P Pack each way into 8 bytes (LRU or FIFO, s + b >= 16, E <= 256). \n\
+          -D<num> Decode the whole trace first, on <num> threads. \n\
+          -j<num> Simulate on <num> threads, each owning some of the sets (no -i). \n\
+          -T<num> Simulate on <num> threads, each taking a stretch of the trace. \n\
+          -w<num> With -T or -I, warm each stretch on the <num> records before it. \n\
+          -G<grid> Simulate every configuration of a grid such as \n\
+                   \"s=0-8 E=1,2,4 b=4-6 p=LFf a=0\" and print a table. \n\
+                   Axes not in the grid come from -s, -E, -b, -L/-F/-f, -a. \n\
+          -g<file> Like -G, with the grid in a JSON config. \n\
+                   With -G or -g, -j<num> is the number of sweep threads. \n\
+          -S Print the LRU miss ratio of every cache with 2^0 to 2^s sets \n\
+             and 1 to E ways, from one stack distance pass per set count. \n\
+          -r<rate> Approximate the LRU miss ratio curve of fully associative \n\
+                   caches of up to 2^s * E lines by SHARDS sampling of \n\
+                   <rate> of the blocks, with 95%% confidence intervals. \n\
+          -m<num> Like -r, tracking at most <num> blocks at a falling rate. \n\
+          -k<num> Simulate about 1 in <num> sets and scale the counts up, \n\
+                  with 95%% confidence intervals. \n\
+          -I<num> Cut the trace into intervals of <num> records, cluster them \n\
+                  into phases by the pages they touch, and estimate the counts \n\
+                  from one simulated interval per phase. \n\
+          -K<num> With -I, the most phases to find (default %d). \n\
+          -R Simulate the decoded trace set by set, for large caches. \n\
+          -W<num> Like -R, but read and reorder <num> records at a time. \n\
           -s<num> Number of set index bits. \n\
           -E<num> Number of lines per set. \n\
           -b<num> Number of block offset bits. \n\
           -t<file> Trace file. \n\
           -L Use LRU eviction policy.- \n\
-          -F Use LFU eviction poilcy\n");
+          -F Use LFU eviction poilcy\n\
+          -f Use FIFO eviction policy.\n\
+          -a<num> With -F, halve the counts of a set every <num> accesses to it.\n",
+             PHASE_CLUSTERS);
       exit(1);
     }
   }
+  if (traceFile == NULL) {
+    printf("Error: no trace file, use -t<file>\n");
+    exit(1);
+  }
+  // Each run is one mode. Refuse flags that another mode would ignore.
+  bool shards = shardsMode != 0;
+  int modes = pipelined + (simulateThreads > 1 && !sweeping) +
+              (timeThreads > 1) + reordered + (sampleRatio > 1) +
+              (phaseInterval > 0) + surface + sweeping + shards;
+  if (modes > 1) {
+    printf("Error: -p, -j, -T, -R/-W, -k, -I, -S, -G/-g and -r/-m are "
+           "separate modes, pick one\n");
+    exit(1);
+  }
+  if (shardsLimit != 0 && shardsRate != 0) {
+    printf("Error: -r and -m are separate modes, pick one\n");
+    exit(1);
+  }
+  if (shardsMode == 'm' && shardsLimit <= 0) {
+    printf("Error: -m must track at least one block\n");
+    exit(1);
+  }
+  if (decodeThreads > 0 && modes > 0 && !reordered && !surface &&
+      phaseInterval <= 0) {
+    printf("Error: -D only combines with -R, -W, -S and -I\n");
+    exit(1);
+  }
+  if (warmup >= 0 && timeThreads <= 1 && phaseInterval <= 0) {
+    printf("Error: -w only applies to -T and -I\n");
+    exit(1);
+  }
+  if (clustered && phaseInterval <= 0) {
+    printf("Error: -K only applies to -I\n");
+    exit(1);
+  }
+  if (shards) {
+    runShards(traceFile, shardsRate, shardsMode == 'm' ? shardsLimit : 0,
+              &cache);
+    return 0;
+  }
+  if (surface) {
+    runStackSurface(traceFile, decodeThreads, &cache);
+    return 0;
+  }
+  if (sweeping) {
+    runSweep(traceFile, &grid,
+             simulateThreads > 0 ? simulateThreads
+                                 : (int)sysconf(_SC_NPROCESSORS_ONLN),
+             &cache);
+    return 0;
+  }
+  // the block index is shared by all sets, so sharded runs go without it
+  if (simulateThreads > 1)
+    cache.indexed = 0;
+  // by default, warm time shards on a few accesses per line
+  if (warmup < 0)
+    warmup = (long)TIMESHARD_WARMUP * cache.linesPerSet << cache.setBits;
   // initializes the cache
   cacheSetUp(&cache, "L1");
   // check the flag and call appropriate function
-  runTrace(traceFile, &cache);
+  if (phaseInterval > 0) {
+    runTracePhases(traceFile, decodeThreads, phaseInterval, phaseClusters,
+                   warmup, &cache);
+    deallocate(&cache);
+    return 0;
+  }
+  if (sampleRatio > 1) {
+    runTraceSampled(traceFile, sampleRatio, &cache);
+    deallocate(&cache);
+    return 0;
+  }
+  if (simulateThreads > 1)
+    runTraceSharded(traceFile, simulateThreads, &cache);
+  else if (timeThreads > 1)
+    runTraceTimeSharded(traceFile, timeThreads, warmup, &cache);
+  else if (reordered)
+    runTraceReordered(traceFile, decodeThreads, window, &cache);
+  else if (decodeThreads > 0)
+    runTraceDecoded(traceFile, decodeThreads, &cache);
+  else if (pipelined)
+    runTracePipelined(traceFile, &cache);
+  else
+    runTrace(traceFile, &cache);
   // prints the summary
   printSummary(&cache);
   //printSummary(cache.hit_count, cache.miss_count, cache.eviction_count);
@@ -0,0 +1,16 @@
+#ifndef MIX_H
+#define MIX_H
+
+// splitmix64: a bijection of 64-bit words in which every input bit reaches
+// every output bit. It hashes blocks, sets and pages for the sampling
+// modes, and with a counter as its input serves as their random numbers.
+static inline unsigned long long splitmix64(unsigned long long x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+#endif // MIX_H
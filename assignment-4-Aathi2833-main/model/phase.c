@@ -0,0 +1,223 @@
+#include "phase.h"
+#include "mix.h"
+#include "xalloc.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline int is_access(char op) {
+  return op == 'L' || op == 'S' || op == 'M';
+}
+
+static double distance(const double *a, const double *b) {
+  double sum = 0;
+  for (int d = 0; d < PHASE_DIMS; d++)
+    sum += (a[d] - b[d]) * (a[d] - b[d]);
+  return sum;
+}
+
+// Signature of each interval, and its number of accesses.
+static void signatures(const trace_buffer *trace, size_t interval, size_t n,
+                       double *points, unsigned long long *references) {
+  memset(points, 0, n * PHASE_DIMS * sizeof(double));
+  for (size_t i = 0; i < n; i++) {
+    size_t end = trace->count - i * interval < interval ? trace->count
+                                                       : (i + 1) * interval;
+    double *point = points + i * PHASE_DIMS;
+    references[i] = 0;
+    for (size_t r = i * interval; r < end; r++) {
+      if (!is_access(trace->ops[r]))
+        continue;
+      unsigned long long page = trace->addresses[r] >> PHASE_PAGE_BITS;
+      point[splitmix64(page) % PHASE_DIMS] += 1;
+      references[i]++;
+    }
+    for (int d = 0; d < PHASE_DIMS && references[i]; d++)
+      point[d] /= references[i];
+  }
+}
+
+// k-means++ seeding: each centroid after the first is an interval drawn
+// with probability proportional to its squared distance from the nearest
+// centroid so far. Returns the number of centroids, less than k only when
+// there are fewer distinct signatures.
+static int seed(const double *points, size_t n, int k, double *centroids) {
+  double *nearest = xmalloc(n * sizeof(double));
+  unsigned long long draws = 0;
+  int count = 1;
+  memcpy(centroids, points, PHASE_DIMS * sizeof(double));
+  for (size_t i = 0; i < n; i++)
+    nearest[i] = distance(points + i * PHASE_DIMS, centroids);
+  while (count < k) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++)
+      total += nearest[i];
+    if (total <= 0)
+      break;
+    double target = (splitmix64(draws++) >> 11) * 0x1p-53 * total;
+    size_t pick = 0;
+    while (pick + 1 < n && (target -= nearest[pick]) >= 0)
+      pick++;
+    double *centroid = centroids + count++ * PHASE_DIMS;
+    memcpy(centroid, points + pick * PHASE_DIMS, PHASE_DIMS * sizeof(double));
+    for (size_t i = 0; i < n; i++) {
+      double d = distance(points + i * PHASE_DIMS, centroid);
+      if (d < nearest[i])
+        nearest[i] = d;
+    }
+  }
+  free(nearest);
+  return count;
+}
+
+// Lloyd's algorithm from the seeded centroids, until no interval changes
+// cluster or PHASE_ITERATIONS rounds have passed.
+static void cluster(const double *points, size_t n, int k, double *centroids,
+                    int *assignment) {
+  int *sizes = xmalloc(k * sizeof(int));
+  for (size_t i = 0; i < n; i++)
+    assignment[i] = -1;
+  for (int round = 0; round < PHASE_ITERATIONS; round++) {
+    int changed = 0;
+    for (size_t i = 0; i < n; i++) {
+      int best = 0;
+      double bestDistance = DBL_MAX;
+      for (int c = 0; c < k; c++) {
+        double d = distance(points + i * PHASE_DIMS, centroids + c * PHASE_DIMS);
+        if (d < bestDistance) {
+          bestDistance = d;
+          best = c;
+        }
+      }
+      changed |= assignment[i] != best;
+      assignment[i] = best;
+    }
+    if (!changed)
+      break;
+    // An emptied cluster keeps its centroid.
+    memset(sizes, 0, k * sizeof(int));
+    for (size_t i = 0; i < n; i++)
+      if (sizes[assignment[i]]++ == 0)
+        memset(centroids + assignment[i] * PHASE_DIMS, 0,
+               PHASE_DIMS * sizeof(double));
+    for (size_t i = 0; i < n; i++)
+      for (int d = 0; d < PHASE_DIMS; d++)
+        centroids[assignment[i] * PHASE_DIMS + d] +=
+            points[i * PHASE_DIMS + d] / sizes[assignment[i]];
+  }
+  free(sizes);
+}
+
+static int by_representative(const void *a, const void *b) {
+  size_t x = ((const phase *)a)->representative;
+  size_t y = ((const phase *)b)->representative;
+  return (x > y) - (x < y);
+}
+
+int phase_select(const trace_buffer *trace, size_t interval, int clusters,
+                 phase **phases) {
+  size_t n = (trace->count + interval - 1) / interval;
+  if (n == 0) {
+    *phases = NULL;
+    return 0;
+  }
+  if ((size_t)clusters > n)
+    clusters = n;
+  double *points = xmalloc(n * PHASE_DIMS * sizeof(double));
+  double *centroids = xmalloc(clusters * PHASE_DIMS * sizeof(double));
+  unsigned long long *references = xmalloc(n * sizeof(*references));
+  int *assignment = xmalloc(n * sizeof(int));
+  signatures(trace, interval, n, points, references);
+  int k = seed(points, n, clusters, centroids);
+  cluster(points, n, k, centroids, assignment);
+
+  phase *all = xmalloc(k * sizeof(phase));
+  double *nearest = xmalloc(k * sizeof(double));
+  memset(all, 0, k * sizeof(phase));
+  for (int c = 0; c < k; c++)
+    nearest[c] = DBL_MAX;
+  for (size_t i = 0; i < n; i++) {
+    phase *p = &all[assignment[i]];
+    double d = distance(points + i * PHASE_DIMS,
+                        centroids + assignment[i] * PHASE_DIMS);
+    p->intervals++;
+    p->references += references[i];
+    if (d < nearest[assignment[i]]) {
+      nearest[assignment[i]] = d;
+      p->representative = i;
+      p->sampled = references[i];
+    }
+  }
+  // Drop the clusters k-means left empty.
+  int count = 0;
+  for (int c = 0; c < k; c++)
+    if (all[c].intervals)
+      all[count++] = all[c];
+  qsort(all, count, sizeof(phase), by_representative);
+
+  free(nearest);
+  free(assignment);
+  free(references);
+  free(centroids);
+  free(points);
+  *phases = all;
+  return count;
+}
+
+// Simulate records [from, to) in batches, dropping their results.
+static void simulate(const trace_buffer *trace, size_t from, size_t to,
+                     Cache *cache) {
+  operateCacheRange(trace->addresses + from, trace->ops + from, to - from,
+                    NULL, cache);
+}
+
+// Representatives run in trace order on one cache. Each starts from what
+// the previous one left, which is stale but full: after a flush, a short
+// warm-up leaves empty ways that turn the interval's evictions into plain
+// misses.
+void phase_simulate(const trace_buffer *trace, size_t interval, size_t warmup,
+                    phase *phases, int count, Cache *cache) {
+  int hits = cache->hit_count, misses = cache->miss_count,
+      evictions = cache->eviction_count;
+  for (int p = 0; p < count; p++) {
+    size_t begin = phases[p].representative * interval;
+    size_t end = trace->count - begin < interval ? trace->count
+                                                 : begin + interval;
+    simulate(trace, begin < warmup ? 0 : begin - warmup, begin, cache);
+    cache->hit_count = cache->miss_count = cache->eviction_count = 0;
+    simulate(trace, begin, end, cache);
+    phases[p].hits = cache->hit_count;
+    phases[p].misses = cache->miss_count;
+    phases[p].evictions = cache->eviction_count;
+  }
+  cache->hit_count = hits;
+  cache->miss_count = misses;
+  cache->eviction_count = evictions;
+}
+
+void phase_print(const phase *phases, int count, size_t interval,
+                 const Cache *cache) {
+  double hits = 0, misses = 0, evictions = 0;
+  unsigned long long references = 0, sampled = 0;
+  size_t intervals = 0;
+  for (int p = 0; p < count; p++) {
+    const phase *ph = &phases[p];
+    // The representative stands for every access of its phase.
+    double weight = ph->sampled ? (double)ph->references / ph->sampled : 0;
+    hits += ph->hits * weight;
+    misses += ph->misses * weight;
+    evictions += ph->evictions * weight;
+    references += ph->references;
+    sampled += ph->sampled;
+    intervals += ph->intervals;
+    fprintf(stderr, "phase %d: interval %zu stands for %zu intervals, "
+                    "%llu references\n",
+            p, ph->representative, ph->intervals, ph->references);
+  }
+  printf("\n%s hits:%.0f misses:%.0f evictions:%.0f", cache->name, hits,
+         misses, evictions);
+  printf("\n%d phases of %zu intervals of %zu records, simulated %llu of "
+         "%llu references",
+         count, intervals, interval, sampled, references);
+}
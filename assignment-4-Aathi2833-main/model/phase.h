@@ -0,0 +1,48 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include "cache.h"
+#include "decode.h"
+#include <stddef.h>
+
+#define PHASE_DIMS 32        // buckets of an interval's signature
+#define PHASE_PAGE_BITS 12   // signatures count accesses per 4 KiB page
+#define PHASE_ITERATIONS 100 // most k-means rounds
+#define PHASE_CLUSTERS 8     // default number of phases
+
+// One phase: the intervals of the trace that k-means put together, and
+// the counts of the one interval simulated for all of them.
+typedef struct phase {
+  size_t representative;         // interval nearest the centroid
+  size_t intervals;              // intervals in the phase
+  unsigned long long references; // L, S and M records in them
+  unsigned long long sampled;    // L, S and M records in the representative
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+} phase;
+
+// Cut the trace into intervals of `interval` records and give each a
+// signature: the share of its accesses that falls in each of PHASE_DIMS
+// buckets of hashed page numbers. Cluster the signatures with k-means into
+// at most `clusters` phases, and pick the interval nearest each centroid to
+// stand for its phase. Returns the number of phases, which are left in
+// *phases in trace order of their representatives. The same trace and
+// arguments always give the same phases.
+int phase_select(const trace_buffer *trace, size_t interval, int clusters,
+                 phase **phases);
+
+// Simulate the representative of each phase, in trace order, warming the
+// cache on the `warmup` records before each interval on top of whatever the
+// previous representative left. Only the interval's own results are
+// counted. The cache counters are left alone.
+void phase_simulate(const trace_buffer *trace, size_t interval, size_t warmup,
+                    phase *phases, int count, Cache *cache);
+
+// Print the hit, miss and eviction totals estimated by weighting each
+// representative by the references of its phase, in the form of
+// printSummary, then what was simulated.
+void phase_print(const phase *phases, int count, size_t interval,
+                 const Cache *cache);
+
+#endif // PHASE_H
@@ -0,0 +1,97 @@
+#include "pipeline.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void spin_pause(int *spins) {
+  if (++*spins < 64)
+    __builtin_ia32_pause();
+  else
+    sched_yield();
+}
+
+static void *reader_main(void *arg) {
+  pipeline *p = arg;
+  unsigned long head = p->head;
+  trace_record record;
+  bool more = true;
+  while (more) {
+    // Wait for the consumer to free a slot.
+    if (head - __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE) == PIPELINE_SLOTS) {
+      double start = now();
+      int spins = 0;
+      while (head - __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE) ==
+             PIPELINE_SLOTS)
+        spin_pause(&spins);
+      p->reader_stall += now() - start;
+    }
+
+    trace_batch *batch = &p->slots[head & (PIPELINE_SLOTS - 1)];
+    int n = 0;
+    while (n < PIPELINE_BATCH && (more = trace_next(&p->reader, &record))) {
+      batch->ops[n] = record.op;
+      batch->addresses[n] = record.address;
+      batch->sizes[n] = record.size;
+      n++;
+    }
+    batch->count = n;
+    if (n > 0)
+      __atomic_store_n(&p->head, ++head, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&p->done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+void pipeline_start(pipeline *p, const char *traceFile) {
+  p->head = 0;
+  p->tail = 0;
+  p->done = false;
+  p->holding = false;
+  p->reader_stall = 0;
+  p->consumer_stall = 0;
+  trace_open(&p->reader, traceFile);
+  if (pthread_create(&p->thread, NULL, reader_main, p) != 0) {
+    printf("Error starting trace reader thread\n");
+    exit(1);
+  }
+}
+
+const trace_batch *pipeline_next(pipeline *p) {
+  unsigned long tail = p->tail;
+  if (p->holding) {
+    __atomic_store_n(&p->tail, ++tail, __ATOMIC_RELEASE);
+    p->holding = false;
+  }
+
+  if (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE) == tail) {
+    double start = now();
+    int spins = 0;
+    while (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE) == tail) {
+      // done is published after the last head update, so re-check head
+      // once more before giving up.
+      if (__atomic_load_n(&p->done, __ATOMIC_ACQUIRE)) {
+        if (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE) != tail)
+          break;
+        p->consumer_stall += now() - start;
+        return NULL;
+      }
+      spin_pause(&spins);
+    }
+    p->consumer_stall += now() - start;
+  }
+
+  p->holding = true;
+  return &p->slots[tail & (PIPELINE_SLOTS - 1)];
+}
+
+void pipeline_finish(pipeline *p) {
+  pthread_join(p->thread, NULL);
+  trace_close(&p->reader);
+}
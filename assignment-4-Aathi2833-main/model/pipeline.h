@@ -0,0 +1,47 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+#define PIPELINE_BATCH 4096 // records per batch
+#define PIPELINE_SLOTS 8    // batches in flight, must be a power of two
+
+// A run of decoded records, in trace order.
+typedef struct trace_batch {
+  int count;
+  char ops[PIPELINE_BATCH];
+  unsigned long long addresses[PIPELINE_BATCH];
+  int sizes[PIPELINE_BATCH];
+} trace_batch;
+
+// Two-stage parse/simulate pipeline. A reader thread decodes the trace into
+// batches and hands them to the consuming thread through a single-producer
+// single-consumer ring. Each side only writes its own index, so no locks
+// are taken.
+typedef struct pipeline {
+  trace_batch slots[PIPELINE_SLOTS];
+  // Next slot the reader fills. Written by the reader only.
+  unsigned long head __attribute__((aligned(64)));
+  // Next slot the consumer takes. Written by the consumer only.
+  unsigned long tail __attribute__((aligned(64)));
+  bool done __attribute__((aligned(64))); // reader reached end of trace
+  bool holding;          // consumer still owns the slot at tail
+  trace_reader reader;
+  pthread_t thread;
+  double reader_stall;   // seconds the reader waited on a full ring
+  double consumer_stall; // seconds the consumer waited on an empty ring
+} pipeline;
+
+// Open the trace and start the reader thread.
+void pipeline_start(pipeline *p, const char *traceFile);
+
+// Return the next batch, or NULL at end of trace. The batch stays valid
+// until the next call.
+const trace_batch *pipeline_next(pipeline *p);
+
+// Join the reader thread and close the trace.
+void pipeline_finish(pipeline *p);
+
+#endif // PIPELINE_H
@@ -0,0 +1,86 @@
+#include "reorder.h"
+#include "xalloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void reorder_init(reorder_buffer *buffer, size_t capacity) {
+  if (capacity > (size_t)~0u) {
+    printf("Error: reorder windows hold at most %u records\n", ~0u);
+    exit(1);
+  }
+  buffer->capacity = capacity;
+  buffer->order = xmalloc(capacity * sizeof(unsigned));
+  buffer->keys = xmalloc(capacity * sizeof(unsigned));
+  buffer->spareOrder = xmalloc(capacity * sizeof(unsigned));
+  buffer->spareKeys = xmalloc(capacity * sizeof(unsigned));
+}
+
+void reorder_free(reorder_buffer *buffer) {
+  free(buffer->order);
+  free(buffer->keys);
+  free(buffer->spareOrder);
+  free(buffer->spareKeys);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+// Stable LSD radix sort of order[0..n) by keys, REORDER_DIGIT_BITS at a
+// time, over the low `bits` bits of the keys.
+static void sort_by_set(reorder_buffer *buffer, size_t n, int bits) {
+  size_t *counts = buffer->counts;
+  for (int shift = 0; shift < bits; shift += REORDER_DIGIT_BITS) {
+    int width = bits - shift < REORDER_DIGIT_BITS ? bits - shift
+                                                  : REORDER_DIGIT_BITS;
+    unsigned digitMask = (1u << width) - 1;
+    memset(counts, 0, sizeof(*counts) << width);
+    for (size_t i = 0; i < n; i++)
+      counts[(buffer->keys[i] >> shift) & digitMask]++;
+    size_t total = 0;
+    for (unsigned d = 0; d <= digitMask; d++) {
+      size_t count = counts[d];
+      counts[d] = total;
+      total += count;
+    }
+    for (size_t i = 0; i < n; i++) {
+      size_t to = counts[(buffer->keys[i] >> shift) & digitMask]++;
+      buffer->spareOrder[to] = buffer->order[i];
+      buffer->spareKeys[to] = buffer->keys[i];
+    }
+    unsigned *t = buffer->order;
+    buffer->order = buffer->spareOrder;
+    buffer->spareOrder = t;
+    t = buffer->keys;
+    buffer->keys = buffer->spareKeys;
+    buffer->spareKeys = t;
+  }
+}
+
+void reorder_simulate(const char *ops, const unsigned long long *addresses,
+                      size_t n, result *results, reorder_buffer *buffer,
+                      Cache *cache) {
+  if (n > buffer->capacity) {
+    printf("Error: reorder window of %zu records exceeds %zu\n", n,
+           buffer->capacity);
+    exit(1);
+  }
+  // Set indexes past 32 bits would need more memory than any host has.
+  int bits = cache->setBits < 32 ? cache->setBits : 32;
+  for (size_t i = 0; i < n; i++) {
+    buffer->order[i] = i;
+    buffer->keys[i] = cache_set(addresses[i], cache);
+  }
+  sort_by_set(buffer, n, bits);
+
+  for (size_t i = 0; i < n; i += REORDER_BATCH) {
+    int count = n - i < REORDER_BATCH ? n - i : REORDER_BATCH;
+    const unsigned *order = buffer->order + i;
+    for (int j = 0; j < count; j++) {
+      buffer->ops[j] = ops[order[j]];
+      buffer->addresses[j] = addresses[order[j]];
+    }
+    operateCacheBatch(buffer->addresses, buffer->ops, count, buffer->results,
+                      cache);
+    for (int j = 0; j < count; j++)
+      results[order[j]] = buffer->results[j];
+  }
+}
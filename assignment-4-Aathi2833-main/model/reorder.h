@@ -0,0 +1,40 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include "cache.h"
+#include <stddef.h>
+
+#define REORDER_DIGIT_BITS 11 // set index bits sorted per radix pass
+#define REORDER_BATCH 4096    // records handed to a batch kernel at once
+
+// Scratch space for reordering windows of up to `capacity` records. Kept
+// between windows so a streaming run allocates once.
+typedef struct reorder_buffer {
+  size_t capacity;
+  unsigned *order;  // trace index of each record, in set-major order
+  unsigned *keys;   // set index of each record in order
+  unsigned *spareOrder;
+  unsigned *spareKeys;
+  size_t counts[1 << REORDER_DIGIT_BITS]; // radix pass digit counts
+  char ops[REORDER_BATCH];
+  unsigned long long addresses[REORDER_BATCH];
+  result results[REORDER_BATCH];
+} reorder_buffer;
+
+// Allocate scratch space for windows of up to capacity records.
+void reorder_init(reorder_buffer *buffer, size_t capacity);
+
+void reorder_free(reorder_buffer *buffer);
+
+// Simulate n trace records set by set instead of in trace order, with the
+// same results and counts as operateCacheBatch. A stable radix sort on the
+// set index puts the records of each set together, still in trace order,
+// so the metadata of one set stays in the host cache while its records
+// run. Sets never share state, so this order gives exact results.
+// results[i] gets the result of record i. n must be at most the capacity
+// of buffer.
+void reorder_simulate(const char *ops, const unsigned long long *addresses,
+                      size_t n, result *results, reorder_buffer *buffer,
+                      Cache *cache);
+
+#endif // REORDER_H
@@ -0,0 +1,82 @@
+#include "setsample.h"
+#include "mix.h"
+#include "stats.h"
+#include "xalloc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void set_sample_init(set_sample *s, int ratio, const Cache *cache) {
+  memset(s, 0, sizeof(*s));
+  s->ratio = ratio;
+  s->sets = 1ULL << cache->setBits;
+  s->group = xmalloc(s->sets);
+  for (unsigned long long set = 0; set < s->sets; set++) {
+    s->group[set] = -1;
+    if (splitmix64(set) % ratio == 0) {
+      s->group[set] = s->sampled % SETSAMPLE_GROUPS;
+      s->groups[s->group[set]].sets++;
+      s->sampled++;
+    }
+  }
+  // Every partition needs a set for the interval, unless nothing is left
+  // out and the totals are exact.
+  if (s->sampled < s->sets && s->sampled < SETSAMPLE_GROUPS) {
+    printf("Error: 1 in %d of %llu sets samples %llu, fewer than %d\n", ratio,
+           s->sets, s->sampled, SETSAMPLE_GROUPS);
+    exit(1);
+  }
+}
+
+// Accesses, misses or evictions of one partition, by position in the
+// summary.
+static unsigned long long group_count(const set_sample_group *group,
+                                      int total) {
+  return total == 0   ? group->hits + group->misses
+         : total == 1 ? group->misses
+                      : group->evictions;
+}
+
+// A total over all sets, scaled up from the sampled sets, and the half width
+// of its 95% interval from the spread of the partition estimates.
+static double estimate(const set_sample *s, int total, double *bound) {
+  double estimates[SETSAMPLE_GROUPS], sum = 0;
+  for (int g = 0; g < SETSAMPLE_GROUPS; g++) {
+    estimates[g] = (double)group_count(&s->groups[g], total) * s->sets /
+                   s->groups[g].sets;
+    sum += group_count(&s->groups[g], total);
+  }
+  *bound = t_interval95(estimates, SETSAMPLE_GROUPS,
+                        (double)s->sampled / s->sets);
+  return sum * s->sets / s->sampled;
+}
+
+// Misses and evictions scale with the sets, but hits follow the references,
+// which a few hot sets can dominate: a sample that misses them sees far too
+// few hits, and every partition misses them alike, so the spread does not
+// show it. Accesses are counted in every set, so hits are taken as the
+// accesses the estimated misses leave. The same scaling applied to the
+// accesses, whose total is known, checks that the load is even enough for
+// the intervals to hold.
+void set_sample_print(const set_sample *s, const Cache *cache) {
+  double missBound, evictionBound, accessBound;
+  double misses = estimate(s, 1, &missBound);
+  double evictions = estimate(s, 2, &evictionBound);
+  double scaled = estimate(s, 0, &accessBound);
+  double accesses = s->dropped;
+  for (int g = 0; g < SETSAMPLE_GROUPS; g++)
+    accesses += group_count(&s->groups[g], 0);
+  printf("\n%s hits:%.0f misses:%.0f evictions:%.0f", cache->name,
+         accesses - misses, misses, evictions);
+  printf("\nsampled %llu of %llu sets, 95%% +- hits:%.0f misses:%.0f "
+         "evictions:%.0f",
+         s->sampled, s->sets, missBound, missBound, evictionBound);
+  if (fabs(scaled - accesses) > accessBound)
+    printf("\nwarning: the sampled sets scale to %.0f of %.0f accesses, the "
+           "load per set is skewed and the misses and evictions of hot sets "
+           "left out may lie outside the intervals",
+           scaled, accesses);
+}
+
+void set_sample_free(set_sample *s) { free(s->group); }
@@ -0,0 +1,49 @@
+#ifndef SETSAMPLE_H
+#define SETSAMPLE_H
+
+#include "cache.h"
+
+#define SETSAMPLE_GROUPS 8 // partitions of the sampled sets, for error bounds
+
+// Counts of the records simulated on one partition of the sampled sets.
+typedef struct set_sample_group {
+  unsigned long long sets;
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+} set_sample_group;
+
+// Set sampling: only a fixed, hashed subset of about 1 in `ratio` sets is
+// simulated, exactly, and the misses and evictions are scaled up by
+// sets / sampled. Hits are the accesses of all sets less those misses. The
+// sampled sets are dealt out in turn to SETSAMPLE_GROUPS partitions, and
+// the spread of their separate estimates gives the confidence interval.
+typedef struct set_sample {
+  int ratio;
+  unsigned long long sets;    // sets in the cache
+  unsigned long long sampled; // sets simulated
+  signed char *group;         // per set: its partition, -1 if not sampled
+  unsigned long long dropped; // accesses to sets that are not sampled, an M
+                              // counting twice
+  set_sample_group groups[SETSAMPLE_GROUPS];
+} set_sample;
+
+// Pick the sets to simulate for a cache that is already set up. The same
+// geometry and ratio always pick the same sets.
+void set_sample_init(set_sample *s, int ratio, const Cache *cache);
+
+// Partition of the set that address maps to, -1 if it is not simulated.
+static inline int set_sample_group_of(const set_sample *s,
+                                      unsigned long long address,
+                                      const Cache *cache) {
+  return s->group[cache_set(address, cache)];
+}
+
+// Print the extrapolated hit, miss and eviction totals with 95% confidence
+// intervals, in the form of printSummary, and a warning when the load per
+// set is too uneven for them.
+void set_sample_print(const set_sample *s, const Cache *cache);
+
+void set_sample_free(set_sample *s);
+
+#endif // SETSAMPLE_H
@@ -0,0 +1,86 @@
+#include "shard.h"
+#include "xalloc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// One simulating thread and the records it gathered for its next batch.
+typedef struct shard {
+  Cache cache; // shares the sets of the real cache, but not its counters
+  int id;
+  int threads;
+  const char *ops;
+  const unsigned long long *addresses;
+  size_t n;
+  result *results;
+  int count;
+  char gatheredOps[SHARD_GATHER];
+  unsigned long long gathered[SHARD_GATHER];
+  size_t origin[SHARD_GATHER]; // trace index of each gathered record
+  result out[SHARD_GATHER];
+} shard;
+
+static void shard_flush(shard *s) {
+  operateCacheBatch(s->gathered, s->gatheredOps, s->count, s->out, &s->cache);
+  for (int i = 0; i < s->count; i++)
+    s->results[s->origin[i]] = s->out[i];
+  s->count = 0;
+}
+
+static void *shard_run(void *arg) {
+  shard *s = arg;
+  for (size_t i = 0; i < s->n; i++) {
+    unsigned long long group =
+        cache_set(s->addresses[i], &s->cache) >> SHARD_GROUP_BITS;
+    if ((int)(group % s->threads) != s->id)
+      continue;
+    s->gatheredOps[s->count] = s->ops[i];
+    s->gathered[s->count] = s->addresses[i];
+    s->origin[s->count] = i;
+    if (++s->count == SHARD_GATHER)
+      shard_flush(s);
+  }
+  shard_flush(s);
+  return NULL;
+}
+
+void shard_simulate(const char *ops, const unsigned long long *addresses,
+                    size_t n, result *results, int threads, Cache *cache) {
+  size_t groups = ((size_t)1 << cache->setBits) >> SHARD_GROUP_BITS;
+  if ((size_t)threads > groups)
+    threads = groups;
+  if (threads <= 1) {
+    operateCacheRange(addresses, ops, n, results, cache);
+    return;
+  }
+
+  shard *shards = xmalloc(threads * sizeof(shard));
+  pthread_t *ids = xmalloc(threads * sizeof(pthread_t));
+  for (int t = 0; t < threads; t++) {
+    shard *s = &shards[t];
+    s->cache = *cache;
+    s->cache.hit_count = s->cache.miss_count = s->cache.eviction_count = 0;
+    s->id = t;
+    s->threads = threads;
+    s->ops = ops;
+    s->addresses = addresses;
+    s->n = n;
+    s->results = results;
+    s->count = 0;
+  }
+  for (int t = 1; t < threads; t++)
+    if (pthread_create(&ids[t], NULL, shard_run, &shards[t]) != 0) {
+      printf("Error starting simulator thread\n");
+      exit(1);
+    }
+  shard_run(&shards[0]);
+  for (int t = 1; t < threads; t++)
+    pthread_join(ids[t], NULL);
+  for (int t = 0; t < threads; t++) {
+    cache->hit_count += shards[t].cache.hit_count;
+    cache->miss_count += shards[t].cache.miss_count;
+    cache->eviction_count += shards[t].cache.eviction_count;
+  }
+  free(ids);
+  free(shards);
+}
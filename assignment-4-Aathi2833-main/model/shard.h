@@ -0,0 +1,24 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "cache.h"
+#include <stddef.h>
+
+#define SHARD_WINDOW (1 << 18) // records simulated per round of threads
+#define SHARD_GATHER 1024      // records a thread hands to a batch kernel
+#define SHARD_GROUP_BITS 3     // consecutive sets that go to one thread
+
+// Simulate n trace records on up to `threads` threads, with the same
+// results and counts as operateCacheBatch. Sets never share state, so the
+// records are split by set: groups of 2^SHARD_GROUP_BITS consecutive sets
+// are dealt out to the threads in turn, which keeps each cache line of
+// per-set metadata on one thread, and every thread simulates the records
+// of its sets in trace order. results[i] gets the result of record i.
+//
+// The cache must not keep a block index, which all sets share. A cache
+// with a single group of sets, such as a fully associative one, is
+// simulated on the calling thread.
+void shard_simulate(const char *ops, const unsigned long long *addresses,
+                    size_t n, result *results, int threads, Cache *cache);
+
+#endif // SHARD_H
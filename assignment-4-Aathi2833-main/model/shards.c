@@ -0,0 +1,293 @@
+#include "shards.h"
+#include "mix.h"
+#include "stats.h"
+#include "xalloc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A tracked block: its node in the treap of last uses and in the heap.
+typedef struct shards_node {
+  unsigned long long block;
+  unsigned long long last; // clock of the last reference, the treap key
+  unsigned hash;           // sampling value, compared with the threshold
+  unsigned priority;       // treap heap order
+  int left;
+  int right;
+  int size; // nodes in the subtree
+} shards_node;
+
+static double sampler_rate(const shards_sampler *s) {
+  return (double)s->threshold / SHARDS_MODULUS /
+         (s->group >= 0 ? SHARDS_GROUPS : 1);
+}
+
+// Treap over last use. Keys are unique: each clock tick is one reference.
+static int size_of(const shards_sampler *s, int n) {
+  return n >= 0 ? s->nodes[n].size : 0;
+}
+
+static void update(shards_sampler *s, int n) {
+  s->nodes[n].size =
+      1 + size_of(s, s->nodes[n].left) + size_of(s, s->nodes[n].right);
+}
+
+static int merge(shards_sampler *s, int a, int b) {
+  if (a < 0)
+    return b;
+  if (b < 0)
+    return a;
+  if (s->nodes[a].priority > s->nodes[b].priority) {
+    s->nodes[a].right = merge(s, s->nodes[a].right, b);
+    update(s, a);
+    return a;
+  }
+  s->nodes[b].left = merge(s, a, s->nodes[b].left);
+  update(s, b);
+  return b;
+}
+
+// Split n into keys below key and keys at or above it.
+static void split(shards_sampler *s, int n, unsigned long long key, int *lo,
+                  int *hi) {
+  if (n < 0) {
+    *lo = *hi = -1;
+  } else if (s->nodes[n].last < key) {
+    split(s, s->nodes[n].right, key, &s->nodes[n].right, hi);
+    update(s, n);
+    *lo = n;
+  } else {
+    split(s, s->nodes[n].left, key, lo, &s->nodes[n].left);
+    update(s, n);
+    *hi = n;
+  }
+}
+
+static void treap_insert(shards_sampler *s, int n) {
+  int lo, hi;
+  s->nodes[n].left = s->nodes[n].right = -1;
+  s->nodes[n].size = 1;
+  split(s, s->root, s->nodes[n].last, &lo, &hi);
+  s->root = merge(s, merge(s, lo, n), hi);
+}
+
+static void treap_remove(shards_sampler *s, int n) {
+  int lo, mid, hi;
+  split(s, s->root, s->nodes[n].last, &lo, &hi);
+  split(s, hi, s->nodes[n].last + 1, &mid, &hi);
+  s->root = merge(s, lo, hi);
+}
+
+// Tracked blocks used after key: the reuse distance of a block last used
+// at key.
+static int used_after(const shards_sampler *s, unsigned long long key) {
+  int count = 0, n = s->root;
+  while (n >= 0) {
+    if (s->nodes[n].last > key) {
+      count += 1 + size_of(s, s->nodes[n].right);
+      n = s->nodes[n].left;
+    } else {
+      n = s->nodes[n].right;
+    }
+  }
+  return count;
+}
+
+static void heap_push(shards_sampler *s, int n) {
+  size_t i = s->heapCount++;
+  while (i > 0 && s->nodes[s->heap[(i - 1) / 2]].hash < s->nodes[n].hash) {
+    s->heap[i] = s->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s->heap[i] = n;
+}
+
+static int heap_pop(shards_sampler *s) {
+  int top = s->heap[0], n = s->heap[--s->heapCount];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= s->heapCount)
+      break;
+    if (child + 1 < s->heapCount &&
+        s->nodes[s->heap[child + 1]].hash > s->nodes[s->heap[child]].hash)
+      child++;
+    if (s->nodes[s->heap[child]].hash <= s->nodes[n].hash)
+      break;
+    s->heap[i] = s->heap[child];
+    i = child;
+  }
+  s->heap[i] = n;
+  return top;
+}
+
+static void sampler_init(shards_sampler *s, int group, unsigned threshold,
+                         size_t limit) {
+  memset(s, 0, sizeof(*s));
+  s->group = group;
+  s->threshold = threshold;
+  s->limit = limit;
+  s->freeNode = -1;
+  s->root = -1;
+  // A fixed-size sampler holds one block over its limit before evicting.
+  s->capacity = limit ? limit + 1 : 1024;
+  s->nodes = xmalloc(s->capacity * sizeof(shards_node));
+  if (limit)
+    s->heap = xmalloc(s->capacity * sizeof(int));
+  blockindex_init(&s->map, s->capacity);
+  s->bins = xcalloc(SHARDS_BINS + 1, sizeof(double));
+}
+
+static void sampler_free(shards_sampler *s) {
+  blockindex_free(&s->map);
+  free(s->nodes);
+  free(s->heap);
+  free(s->bins);
+}
+
+// A fixed-rate sampler tracks ever more blocks: double its room.
+static void sampler_grow(shards_sampler *s) {
+  s->capacity *= 2;
+  s->nodes = xrealloc(s->nodes, s->capacity * sizeof(shards_node));
+  blockindex_free(&s->map);
+  blockindex_init(&s->map, s->capacity);
+  for (size_t n = 0; n < s->used; n++)
+    blockindex_insert(&s->map, s->nodes[n].block, n);
+}
+
+// Over the limit: stop sampling the blocks with the highest hash, lowering
+// the threshold to it, and scale the histogram to the new rate.
+static void sampler_evict(shards_sampler *s) {
+  double before = sampler_rate(s);
+  unsigned top = s->nodes[s->heap[0]].hash;
+  while (s->heapCount > 0 && s->nodes[s->heap[0]].hash == top) {
+    int n = heap_pop(s);
+    treap_remove(s, n);
+    blockindex_remove(&s->map, s->nodes[n].block);
+    s->nodes[n].left = s->freeNode;
+    s->freeNode = n;
+  }
+  s->threshold = top;
+  double scale = sampler_rate(s) / before;
+  for (int i = 0; i <= SHARDS_BINS; i++)
+    s->bins[i] *= scale;
+  s->cold *= scale;
+}
+
+static void sampler_access(shards_sampler *s, const shards *a,
+                           unsigned long long block, unsigned hash) {
+  unsigned long long now = ++s->clock;
+  int n = blockindex_find(&s->map, block);
+  if (n >= 0) {
+    double distance = used_after(s, s->nodes[n].last) / sampler_rate(s);
+    size_t bin = distance / a->binWidth;
+    s->bins[bin < SHARDS_BINS ? bin : SHARDS_BINS] += 1;
+    treap_remove(s, n);
+    s->nodes[n].last = now;
+    treap_insert(s, n);
+    return;
+  }
+  s->cold += 1;
+  if (s->freeNode >= 0) {
+    n = s->freeNode;
+    s->freeNode = s->nodes[n].left;
+  } else {
+    if (s->used == s->capacity)
+      sampler_grow(s);
+    n = s->used++;
+  }
+  s->nodes[n].block = block;
+  s->nodes[n].last = now;
+  s->nodes[n].hash = hash;
+  s->nodes[n].priority = splitmix64(block ^ now);
+  blockindex_insert(&s->map, block, n);
+  treap_insert(s, n);
+  if (s->limit) {
+    heap_push(s, n);
+    if (s->heapCount > s->limit)
+      sampler_evict(s);
+  }
+}
+
+void shards_init(shards *s, double rate, size_t limit, int maxLines,
+                 int blockBits) {
+  memset(s, 0, sizeof(*s));
+  s->geometry.blockBits = blockBits;
+  cache_geometry(&s->geometry);
+  s->maxLines = maxLines;
+  s->binWidth = (maxLines + SHARDS_BINS - 1) / SHARDS_BINS;
+  unsigned threshold = limit ? SHARDS_MODULUS : rate * SHARDS_MODULUS + 0.5;
+  if (threshold < 1)
+    threshold = 1;
+  size_t groupLimit = limit / SHARDS_GROUPS ? limit / SHARDS_GROUPS : 1;
+  sampler_init(&s->all, -1, threshold, limit);
+  for (int g = 0; g < SHARDS_GROUPS; g++)
+    sampler_init(&s->groups[g], g, threshold, limit ? groupLimit : 0);
+}
+
+void shards_access(shards *s, char op, unsigned long long address) {
+  if (op != 'L' && op != 'S' && op != 'M')
+    return;
+  unsigned long long block = address_to_block(address, &s->geometry);
+  unsigned long long h = splitmix64(block);
+  unsigned hash = h >> 40; // 24 bits
+  shards_sampler *group = &s->groups[h % SHARDS_GROUPS];
+  for (int r = 0; r < 1 + (op == 'M'); r++) {
+    s->references++;
+    if (hash < s->all.threshold)
+      sampler_access(&s->all, s, block, hash);
+    if (hash < group->threshold)
+      sampler_access(group, s, block, hash);
+  }
+}
+
+// Miss ratio of a fully associative cache of `lines` lines: the share of
+// references first seen or at a reuse distance of at least `lines`. This
+// is the SHARDS_adj correction: the histogram is divided by the references
+// the sampler was expected to see at its final rate, not by what it saw,
+// as if the difference were distance 0 hits. It removes most of the bias a
+// few very hot blocks cause. The rescaled histogram of a fixed-size
+// sampler has the same expectation, so it gets the same correction.
+static double sampler_ratio(const shards *a, const shards_sampler *s,
+                            int lines) {
+  double total = a->references * sampler_rate(s), misses = s->cold;
+  for (int i = 0; i <= SHARDS_BINS; i++)
+    if ((long)i * a->binWidth >= lines)
+      misses += s->bins[i];
+  if (total <= misses)
+    return total > 0 ? 1.0 : 0.0;
+  return misses / total;
+}
+
+void shards_print(const shards *s) {
+  printf("SHARDS LRU miss ratios, %s, final rate %.6f, %d byte blocks, "
+         "%llu references, %llu sampled\n",
+         s->all.limit ? "fixed size" : "fixed rate", sampler_rate(&s->all),
+         1 << s->geometry.blockBits, s->references, s->all.clock);
+  // A sampled distance of 1 stands for 1 / rate lines.
+  printf("Caches under %.0f lines are below the resolution of the rate.\n",
+         ceil(1 / sampler_rate(&s->all)));
+  printf("%10s %12s %10s %10s\n", "lines", "bytes", "miss ratio", "95% +-");
+  for (long lines = 1;; lines *= 2) {
+    if (lines > s->maxLines)
+      lines = s->maxLines;
+    double ratios[SHARDS_GROUPS];
+    for (int g = 0; g < SHARDS_GROUPS; g++)
+      ratios[g] = sampler_ratio(s, &s->groups[g], lines);
+    // The estimate samples SHARDS_GROUPS times as many blocks as a group,
+    // out of a finite population: sampling every block has no error.
+    double bound =
+        t_interval95(ratios, SHARDS_GROUPS, sampler_rate(&s->all));
+    printf("%10ld %12lld %10.6f %10.6f\n", lines,
+           (long long)lines << s->geometry.blockBits,
+           sampler_ratio(s, &s->all, lines), bound);
+    if (lines == s->maxLines)
+      break;
+  }
+}
+
+void shards_free(shards *s) {
+  sampler_free(&s->all);
+  for (int g = 0; g < SHARDS_GROUPS; g++)
+    sampler_free(&s->groups[g]);
+}
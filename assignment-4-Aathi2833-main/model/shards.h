@@ -0,0 +1,61 @@
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include "blockindex.h"
+#include "cache.h"
+#include <stddef.h>
+
+#define SHARDS_MODULUS (1 << 24) // hashed blocks are sampled below T of this
+#define SHARDS_GROUPS 8          // hash partitions used for error bounds
+#define SHARDS_BINS 4096         // histogram bins of scaled reuse distance
+
+// One SHARDS sampler. A block is sampled when the low 24 bits of its hash
+// are below the threshold T, a spatial sample at rate T / 2^24 that keeps
+// every reference to the blocks it picks. Reuse distances measured among
+// sampled blocks are divided by the rate to estimate true distances.
+typedef struct shards_sampler {
+  int group;                   // hash partition sampled, -1 for all
+  unsigned threshold;          // T
+  size_t limit;                // most blocks tracked at once, 0 for no limit
+  unsigned long long clock;    // sampled references so far
+  BlockIndex map;              // block -> node
+  struct shards_node *nodes;
+  size_t capacity;             // nodes allocated
+  size_t used;                 // nodes ever handed out
+  int freeNode;                // list of evicted nodes, -1 if empty
+  int root;                    // treap of tracked blocks by last use
+  int *heap;                   // max-heap of tracked blocks by hash
+  size_t heapCount;
+  double *bins;                // SHARDS_BINS bins, then references past them
+  double cold;                 // first references
+} shards_sampler;
+
+// A SHARDS analysis: the estimate, and SHARDS_GROUPS samplers over
+// disjoint hash partitions whose spread gives its confidence interval.
+typedef struct shards {
+  Cache geometry;     // block size, for address_to_block
+  int maxLines;
+  int binWidth;       // lines per histogram bin
+  unsigned long long references;
+  shards_sampler all;
+  shards_sampler groups[SHARDS_GROUPS];
+} shards;
+
+// Set up a fixed-rate analysis (limit 0), which samples rate of all blocks,
+// or a fixed-size one (rate 1), which starts by sampling everything and
+// lowers the rate whenever more than `limit` blocks are tracked, so memory
+// stays constant. Curves cover fully associative LRU caches of 1 to
+// maxLines lines of 2^blockBits bytes.
+void shards_init(shards *s, double rate, size_t limit, int maxLines,
+                 int blockBits);
+
+// Feed one L, S or M record. An M is two references, the second a hit.
+void shards_access(shards *s, char op, unsigned long long address);
+
+// Print the estimated miss ratio of each power of two cache size with a
+// 95% confidence interval from the spread of the partition samplers.
+void shards_print(const shards *s);
+
+void shards_free(shards *s);
+
+#endif // SHARDS_H
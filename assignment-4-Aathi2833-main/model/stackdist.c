@@ -0,0 +1,147 @@
+#include "stackdist.h"
+#include "blockindex.h"
+#include "cache.h"
+#include "xalloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fenwick tree over positions 1..n.
+static void fenwick_add(int *tree, size_t n, size_t pos, int delta) {
+  for (; pos <= n; pos += pos & -pos)
+    tree[pos] += delta;
+}
+
+static int fenwick_sum(const int *tree, size_t pos) {
+  int sum = 0;
+  for (; pos > 0; pos -= pos & -pos)
+    sum += tree[pos];
+  return sum;
+}
+
+void stack_surface_build(const trace_buffer *trace, int maxSetBits,
+                         int maxWays, int blockBits, stack_surface *surface) {
+  Cache geometry;
+  memset(&geometry, 0, sizeof(geometry));
+  geometry.setBits = maxSetBits;
+  geometry.blockBits = blockBits;
+  cache_geometry(&geometry);
+
+  // Simulated accesses, each with a dense id for its block and the set it
+  // maps to with the most set bits.
+  size_t n = 0;
+  for (size_t i = 0; i < trace->count; i++)
+    n += trace->ops[i] == 'L' || trace->ops[i] == 'S' || trace->ops[i] == 'M';
+  int *ids = xcalloc(n, sizeof(int));
+  unsigned long long *sets = xcalloc(n, sizeof(unsigned long long));
+  BlockIndex blocks;
+  blockindex_init(&blocks, n);
+  int distinct = 0;
+  surface->references = 0;
+  for (size_t i = 0, k = 0; i < trace->count; i++) {
+    char op = trace->ops[i];
+    if (op != 'L' && op != 'S' && op != 'M')
+      continue;
+    unsigned long long address = trace->addresses[i];
+    unsigned long long block = address_to_block(address, &geometry);
+    int id = blockindex_find(&blocks, block);
+    if (id < 0) {
+      id = distinct++;
+      blockindex_insert(&blocks, block, id);
+    }
+    ids[k] = id;
+    sets[k++] = cache_set(address, &geometry);
+    surface->references += 1 + (op == 'M');
+  }
+  blockindex_free(&blocks);
+
+  surface->maxSetBits = maxSetBits;
+  surface->maxWays = maxWays;
+  surface->blockBits = blockBits;
+  surface->misses = xcalloc((size_t)(maxSetBits + 1) * maxWays,
+                            sizeof(unsigned long long));
+  // distances[d] for d < maxWays counts accesses at stack distance d, and
+  // distances[maxWays] those further back or first uses.
+  unsigned long long *distances = xcalloc(maxWays + 1, sizeof(*distances));
+  size_t *order = xcalloc(n, sizeof(size_t));
+  size_t *spare = xcalloc(n, sizeof(size_t));
+  int *tree = xcalloc(n + 1, sizeof(int));
+  size_t *last = xcalloc(distinct, sizeof(size_t)); // position + 1, 0: none
+  for (size_t k = 0; k < n; k++)
+    order[k] = k;
+
+  for (int s = 0; s <= maxSetBits; s++) {
+    if (s > 0) {
+      // Stable partition on set bit s - 1 refines the order by one bit.
+      size_t zeros = 0, ones;
+      for (size_t k = 0; k < n; k++)
+        zeros += !((sets[order[k]] >> (s - 1)) & 1);
+      ones = zeros;
+      zeros = 0;
+      for (size_t k = 0; k < n; k++) {
+        size_t a = order[k];
+        if ((sets[a] >> (s - 1)) & 1)
+          spare[ones++] = a;
+        else
+          spare[zeros++] = a;
+      }
+      size_t *t = order;
+      order = spare;
+      spare = t;
+    }
+    memset(tree, 0, (n + 1) * sizeof(int));
+    memset(last, 0, distinct * sizeof(size_t));
+    memset(distances, 0, (maxWays + 1) * sizeof(*distances));
+    for (size_t pos = 1; pos <= n; pos++) {
+      int id = ids[order[pos - 1]];
+      size_t before = last[id];
+      size_t d = maxWays;
+      if (before) {
+        d = fenwick_sum(tree, pos - 1) - fenwick_sum(tree, before);
+        if (d > (size_t)maxWays)
+          d = maxWays;
+        fenwick_add(tree, n, before, -1);
+      }
+      distances[d]++;
+      fenwick_add(tree, n, pos, 1);
+      last[id] = pos;
+    }
+    // An E-way cache misses on every access at distance E or more.
+    unsigned long long misses = distances[maxWays];
+    for (int E = maxWays; E >= 1; E--) {
+      surface->misses[(size_t)s * maxWays + E - 1] = misses;
+      misses += distances[E - 1];
+    }
+  }
+  free(last);
+  free(tree);
+  free(spare);
+  free(order);
+  free(distances);
+  free(sets);
+  free(ids);
+}
+
+void stack_surface_print(const stack_surface *surface) {
+  printf("LRU miss ratios, %d byte blocks, %llu references\n",
+         1 << surface->blockBits, surface->references);
+  printf("%5s", "s\\E");
+  for (int E = 1; E <= surface->maxWays; E++)
+    printf(" %8d", E);
+  printf("\n");
+  for (int s = 0; s <= surface->maxSetBits; s++) {
+    printf("%5d", s);
+    for (int E = 1; E <= surface->maxWays; E++) {
+      unsigned long long misses =
+          surface->misses[(size_t)s * surface->maxWays + E - 1];
+      printf(" %8.6f", surface->references
+                           ? (double)misses / surface->references
+                           : 0.0);
+    }
+    printf("\n");
+  }
+}
+
+void stack_surface_free(stack_surface *surface) {
+  free(surface->misses);
+  surface->misses = NULL;
+}
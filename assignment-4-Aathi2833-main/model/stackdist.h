@@ -0,0 +1,37 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include "decode.h"
+
+// LRU miss counts of every cache with 2^0 to 2^maxSetBits sets and 1 to
+// maxWays ways, all with 2^blockBits byte blocks.
+typedef struct stack_surface {
+  int maxSetBits;
+  int maxWays;
+  int blockBits;
+  // L, S and M records plus one more for each M, the hits + misses of any
+  // of the caches
+  unsigned long long references;
+  // misses[s * maxWays + E - 1]: misses of the cache with 2^s sets of E ways
+  unsigned long long *misses;
+} stack_surface;
+
+// Fill in the surface from one pass over the trace per set count. LRU is
+// a stack algorithm: an access hits in an E-way set exactly when fewer
+// than E other blocks of its set were used since its block last was, its
+// stack distance. The accesses are put in set-major order, which for
+// 2^(s+1) sets is a stable partition of the order for 2^s sets on one
+// more set bit. Each set is then a run of positions, and a Fenwick tree
+// over the positions, holding a 1 at the last use of each block, counts
+// the distinct blocks between two uses of a block in O(log n). The whole
+// surface takes O((maxSetBits + 1) n log n) time and O(n) memory.
+void stack_surface_build(const trace_buffer *trace, int maxSetBits,
+                         int maxWays, int blockBits, stack_surface *surface);
+
+// Print the miss ratios, misses / references, one row per set count and
+// one column per associativity.
+void stack_surface_print(const stack_surface *surface);
+
+void stack_surface_free(stack_surface *surface);
+
+#endif // STACKDIST_H
@@ -0,0 +1,13 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Two-sided 95% point of Student's t with df degrees of freedom.
+double student_t95(int df);
+
+// Half width of the 95% confidence interval of the mean of n independent
+// estimates, from their spread: Student's t with n - 1 degrees of freedom.
+// sampled is the share of the population they cover together, and shrinks
+// the interval to 0 as it reaches 1. 0 when n < 2.
+double t_interval95(const double *estimates, int n, double sampled);
+
+#endif // STATS_H
@@ -0,0 +1,305 @@
+#include "sweep.h"
+#include "fileio.h"
+#include "json.h"
+#include "xalloc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const axis_keys[SWEEP_AXES] = {
+    "SetBits (s)", "Ways (E)", "BlockBits (b)", "Policy", "Aging (a)"};
+static const char axis_letters[SWEEP_AXES] = {'s', 'E', 'b', 'p', 'a'};
+
+static int policy_of(char letter) {
+  switch (letter) {
+  case 'L':
+    return POLICY_LRU;
+  case 'F':
+    return POLICY_LFU;
+  case 'f':
+    return POLICY_FIFO;
+  }
+  printf("Error: unknown sweep policy '%c', use L, F or f\n", letter);
+  exit(1);
+}
+
+static void add_value(sweep_grid *grid, int axis, long value) {
+  bool valid = value >= 0 && value < (axis == SWEEP_WAYS ? 1L << 20 : 64) &&
+               (axis != SWEEP_WAYS || value > 0);
+  if (axis == SWEEP_AGING)
+    valid = value >= 0 && value <= 0x7fffffff;
+  if (!valid) {
+    printf("Error: %ld is not a valid sweep value for %c\n", value,
+           axis_letters[axis]);
+    exit(1);
+  }
+  if (grid->count[axis] == SWEEP_MAX_VALUES) {
+    printf("Error: more than %d sweep values for %c\n", SWEEP_MAX_VALUES,
+           axis_letters[axis]);
+    exit(1);
+  }
+  grid->values[axis][grid->count[axis]++] = value;
+}
+
+static int axis_of_letter(char letter) {
+  for (int axis = 0; axis < SWEEP_AXES; axis++)
+    if (axis_letters[axis] == letter)
+      return axis;
+  printf("Error: unknown sweep axis '%c', use s, E, b, p or a\n", letter);
+  exit(1);
+}
+
+void sweep_grid_parse(sweep_grid *grid, const char *spec) {
+  const char *p = spec;
+  while (*p) {
+    if (*p == ' ' || *p == ';') {
+      p++;
+      continue;
+    }
+    if (p[1] != '=') {
+      printf("Error: bad sweep axis at \"%s\"\n", p);
+      exit(1);
+    }
+    int axis = axis_of_letter(p[0]);
+    p += 2;
+    while (*p && *p != ' ' && *p != ';') {
+      if (*p == ',') {
+        p++;
+      } else if (axis == SWEEP_POLICY) {
+        add_value(grid, axis, policy_of(*p++));
+      } else {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p) {
+          printf("Error: bad sweep value at \"%s\"\n", p);
+          exit(1);
+        }
+        if (*end == '-') {
+          p = end + 1;
+          hi = strtol(p, &end, 10);
+          if (end == p || hi < lo) {
+            printf("Error: bad sweep range at \"%s\"\n", p);
+            exit(1);
+          }
+        }
+        for (long v = lo; v <= hi; v++)
+          add_value(grid, axis, v);
+        p = end;
+      }
+    }
+  }
+}
+
+// Add one JSON number, or policy string, to an axis.
+static void add_json_value(sweep_grid *grid, int axis,
+                           struct json_value_s *value) {
+  if (axis == SWEEP_POLICY && value->type == json_type_string) {
+    const struct json_string_s *s = value->payload;
+    for (size_t i = 0; i < s->string_size; i++)
+      add_value(grid, axis, policy_of(s->string[i]));
+  } else if (axis != SWEEP_POLICY && value->type == json_type_number) {
+    const struct json_number_s *n = value->payload;
+    add_value(grid, axis, strtol(n->number, NULL, 10));
+  } else {
+    printf("Error: bad value for \"%s\" in sweep config\n", axis_keys[axis]);
+    exit(1);
+  }
+}
+
+void sweep_grid_load(sweep_grid *grid, char *configFile) {
+  char *payload = readfile(configFile);
+  struct json_value_s *root = json_parse(payload, strlen(payload));
+  if (root == NULL || root->type != json_type_object) {
+    printf("Error: sweep config %s is not a JSON object\n", configFile);
+    exit(1);
+  }
+  const struct json_object_s *object = root->payload;
+  for (const struct json_object_element_s *e = object->start; e;
+       e = e->next) {
+    int axis = 0;
+    while (axis < SWEEP_AXES && strcmp(e->name->string, axis_keys[axis]))
+      axis++;
+    if (axis == SWEEP_AXES) {
+      printf("Error: unknown key \"%s\" in sweep config\n", e->name->string);
+      exit(1);
+    }
+    if (e->value->type != json_type_array) {
+      add_json_value(grid, axis, e->value);
+      continue;
+    }
+    const struct json_array_s *array = e->value->payload;
+    for (const struct json_array_element_s *v = array->start; v; v = v->next)
+      add_json_value(grid, axis, v->value);
+  }
+  free(root);
+  free(payload);
+}
+
+void sweep_grid_fill(sweep_grid *grid, const Cache *cache) {
+  const int defaults[SWEEP_AXES] = {cache->setBits, cache->linesPerSet,
+                                    cache->blockBits, cache->lfu,
+                                    cache->lfuAging};
+  for (int axis = 0; axis < SWEEP_AXES; axis++) {
+    if (grid->count[axis] > 0)
+      continue;
+    if (defaults[axis] < 0) {
+      printf("Error: the sweep has no values for %c\n", axis_letters[axis]);
+      exit(1);
+    }
+    add_value(grid, axis, defaults[axis]);
+  }
+}
+
+size_t sweep_points(const sweep_grid *grid, sweep_point **points) {
+  size_t n = 1;
+  for (int axis = 0; axis < SWEEP_AXES; axis++)
+    n *= grid->count[axis];
+  *points = xcalloc(n, sizeof(sweep_point));
+  for (size_t i = 0; i < n; i++) {
+    int at[SWEEP_AXES];
+    size_t rest = i;
+    for (int axis = SWEEP_AXES - 1; axis >= 0; axis--) {
+      at[axis] = grid->values[axis][rest % grid->count[axis]];
+      rest /= grid->count[axis];
+    }
+    sweep_point *p = &(*points)[i];
+    p->setBits = at[SWEEP_SETS];
+    p->linesPerSet = at[SWEEP_WAYS];
+    p->blockBits = at[SWEEP_BLOCKS];
+    p->lfu = at[SWEEP_POLICY];
+    p->lfuAging = at[SWEEP_AGING];
+    if (p->setBits + p->blockBits >= 64) {
+      printf("Error: sweep point s=%d b=%d has no tag bits left\n",
+             p->setBits, p->blockBits);
+      exit(1);
+    }
+  }
+  return n;
+}
+
+// The points of one thread, taken from the back by their owner and from
+// the front by thieves.
+typedef struct sweep_queue {
+  pthread_mutex_t lock;
+  size_t *tasks;
+  size_t head;
+  size_t tail;
+} sweep_queue;
+
+typedef struct sweep_worker {
+  int id;
+  int threads;
+  sweep_queue *queues;
+  const trace_buffer *trace;
+  sweep_point *points;
+  const Cache *options;
+} sweep_worker;
+
+static bool queue_take(sweep_queue *q, bool own, size_t *task) {
+  bool found = false;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) {
+    *task = own ? q->tasks[--q->tail] : q->tasks[q->head++];
+    found = true;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return found;
+}
+
+static void simulate_point(const trace_buffer *trace, sweep_point *point,
+                           const Cache *options) {
+  Cache cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.setBits = point->setBits;
+  cache.linesPerSet = point->linesPerSet;
+  cache.blockBits = point->blockBits;
+  cache.lfu = point->lfu;
+  cache.lfuAging = point->lfuAging;
+  cache.indexed = options->indexed;
+  cache.hugePages = options->hugePages;
+  cache.packed = options->packed;
+  cacheSetUp(&cache, "L1");
+  operateCacheRange(trace->addresses, trace->ops, trace->count, NULL, &cache);
+  point->hits = cache.hit_count;
+  point->misses = cache.miss_count;
+  point->evictions = cache.eviction_count;
+  deallocate(&cache);
+}
+
+static void *sweep_work(void *arg) {
+  sweep_worker *w = arg;
+  size_t task;
+  for (;;) {
+    bool found = queue_take(&w->queues[w->id], true, &task);
+    // Out of work: steal from the next thread that still has some.
+    for (int k = 1; !found && k < w->threads; k++)
+      found = queue_take(&w->queues[(w->id + k) % w->threads], false, &task);
+    if (!found)
+      return NULL;
+    simulate_point(w->trace, &w->points[task], w->options);
+  }
+}
+
+void sweep_run(const trace_buffer *trace, sweep_point *points, size_t n,
+               int threads, const Cache *options) {
+  if (threads < 1)
+    threads = 1;
+  if ((size_t)threads > n)
+    threads = n ? n : 1;
+  // cacheSetUp would refuse these from a worker thread, partway through.
+  for (size_t i = 0; i < n && options->packed; i++) {
+    const sweep_point *p = &points[i];
+    if ((p->lfu == POLICY_LFU && p->linesPerSet > 1) ||
+        p->linesPerSet > PACKED_MAX_WAYS ||
+        p->setBits + p->blockBits < PACKED_STATE_BITS) {
+      printf("Error: -P needs LRU or FIFO, at most %d ways and s + b >= %d, "
+             "not s=%d E=%d b=%d\n",
+             PACKED_MAX_WAYS, PACKED_STATE_BITS, p->setBits, p->linesPerSet,
+             p->blockBits);
+      exit(1);
+    }
+  }
+  sweep_queue *queues = xcalloc(threads, sizeof(sweep_queue));
+  sweep_worker *workers = xcalloc(threads, sizeof(sweep_worker));
+  pthread_t *ids = xcalloc(threads, sizeof(pthread_t));
+  size_t *tasks = xcalloc(n, sizeof(size_t));
+  // Deal the points round robin, each queue a contiguous run of tasks.
+  size_t next = 0;
+  for (int t = 0; t < threads; t++) {
+    pthread_mutex_init(&queues[t].lock, NULL);
+    queues[t].tasks = tasks + next;
+    for (size_t i = t; i < n; i += threads)
+      tasks[next++] = i;
+    queues[t].tail = tasks + next - queues[t].tasks;
+  }
+  for (int t = 0; t < threads; t++) {
+    workers[t] = (sweep_worker){t, threads, queues, trace, points, options};
+    if (t > 0 && pthread_create(&ids[t], NULL, sweep_work, &workers[t]) != 0) {
+      printf("Error starting sweep thread\n");
+      exit(1);
+    }
+  }
+  sweep_work(&workers[0]);
+  for (int t = 1; t < threads; t++)
+    pthread_join(ids[t], NULL);
+  for (int t = 0; t < threads; t++)
+    pthread_mutex_destroy(&queues[t].lock);
+  free(tasks);
+  free(ids);
+  free(workers);
+  free(queues);
+}
+
+void sweep_print(const sweep_point *points, size_t n) {
+  static const char *const names[] = {"LRU", "LFU", "FIFO"};
+  printf("%5s %6s %5s %6s %6s %10s %10s %10s %9s\n", "s", "E", "b", "policy",
+         "aging", "hits", "misses", "evictions", "miss rate");
+  for (size_t i = 0; i < n; i++) {
+    const sweep_point *p = &points[i];
+    long accesses = (long)p->hits + p->misses;
+    printf("%5d %6d %5d %6s %6d %10d %10d %10d %9.6f\n", p->setBits,
+           p->linesPerSet, p->blockBits, names[p->lfu], p->lfuAging, p->hits,
+           p->misses, p->evictions,
+           accesses ? (double)p->misses / accesses : 0.0);
+  }
+}
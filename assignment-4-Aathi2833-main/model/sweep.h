@@ -0,0 +1,67 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "cache.h"
+#include "decode.h"
+#include <stddef.h>
+
+#define SWEEP_MAX_VALUES 64 // values per axis of a grid
+
+// Axes of a sweep grid.
+enum sweep_axis {
+  SWEEP_SETS = 0,   // s
+  SWEEP_WAYS = 1,   // E
+  SWEEP_BLOCKS = 2, // b
+  SWEEP_POLICY = 3, // policy_enum of the lfu option: L, F or f
+  SWEEP_AGING = 4,  // a
+  SWEEP_AXES = 5
+};
+
+// The values to try on each axis. The sweep is every combination.
+typedef struct sweep_grid {
+  int count[SWEEP_AXES];
+  int values[SWEEP_AXES][SWEEP_MAX_VALUES];
+} sweep_grid;
+
+// One configuration of a sweep and its counts.
+typedef struct sweep_point {
+  int setBits;
+  int linesPerSet;
+  int blockBits;
+  int lfu;
+  int lfuAging;
+  int hits;
+  int misses;
+  int evictions;
+} sweep_point;
+
+// Add the axes given on the command line, e.g. "s=0-8 E=1,2,4 b=4-6 p=LFf":
+// space or ';' separated axes, each a comma separated list of values and
+// lo-hi ranges; policies are the letters of -L, -F and -f.
+void sweep_grid_parse(sweep_grid *grid, const char *spec);
+
+// Add the axes of a JSON config in the style of the 2level configs:
+//   { "SetBits (s)": [0, 2, 4], "Ways (E)": [1, 2], "BlockBits (b)": 4,
+//     "Policy": ["L", "F"], "Aging (a)": [0, 64] }
+// Each key takes a number, a policy letter or an array of them.
+void sweep_grid_load(sweep_grid *grid, char *configFile);
+
+// Give each axis that has no values the one value it has in cache, where
+// a negative value means it was not given.
+void sweep_grid_fill(sweep_grid *grid, const Cache *cache);
+
+// Every combination of the grid, s varying slowest and aging fastest.
+// Returns the number of points; *points is malloc'ed.
+size_t sweep_points(const sweep_grid *grid, sweep_point **points);
+
+// Simulate the whole trace once for each point, on up to `threads`
+// threads. Points are dealt out to the threads up front; a thread that
+// runs out of points steals from the others. options supplies the
+// options that are not swept (-i, -H, -P).
+void sweep_run(const trace_buffer *trace, sweep_point *points, size_t n,
+               int threads, const Cache *options);
+
+// Print the counts of all points as one table, in grid order.
+void sweep_print(const sweep_point *points, size_t n);
+
+#endif // SWEEP_H
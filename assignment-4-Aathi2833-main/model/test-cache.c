@@ -0,0 +1,268 @@
+/*
+ * test-cache.c - Unit tests for the parts of the cache API that no trace
+ *     run reaches. Prints each failed check and exits non-zero if any.
+ */
+#include "cache.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      printf("%s:%d: %s [%s]: %s\n", __FILE__, __LINE__, __func__,          \
+             current->name, #cond);                                         \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+// A cache shape and policy every test runs on.
+typedef struct config {
+  const char *name;
+  int setBits;
+  int linesPerSet;
+  int blockBits;
+  int policy;
+  int indexed;
+  int packed;
+} config;
+
+static const config configs[] = {
+    {"LRU", 2, 4, 4, POLICY_LRU, 0, 0},
+    {"LRU indexed", 2, 4, 4, POLICY_LRU, 1, 0},
+    {"LFU", 2, 4, 4, POLICY_LFU, 0, 0},
+    {"FIFO", 2, 4, 4, POLICY_FIFO, 0, 0},
+    {"direct-mapped", 4, 1, 4, POLICY_LRU, 0, 0},
+    {"fully associative", 0, 128, 4, POLICY_LRU, 0, 0},
+    {"packed", 4, 4, 12, POLICY_LRU, 0, 1},
+};
+
+static const config *current;
+
+static void setup(Cache *cache, const config *c) {
+  memset(cache, 0, sizeof(*cache));
+  cache->setBits = c->setBits;
+  cache->linesPerSet = c->linesPerSet;
+  cache->blockBits = c->blockBits;
+  cache->lfu = c->policy;
+  cache->indexed = c->indexed;
+  cache->packed = c->packed;
+  cacheSetUp(cache, "L1");
+}
+
+// Address of the nth block of the cache's block size.
+static unsigned long long block(const Cache *cache, unsigned long long n) {
+  return n << cache->blockBits;
+}
+
+// Blocks 8 to 11 fall in consecutive sets and 37 in another, so every
+// config holds all five at once.
+static const unsigned long long resident[] = {8, 9, 10, 11, 37};
+#define RESIDENT (sizeof(resident) / sizeof(resident[0]))
+
+static void fill(Cache *cache) {
+  for (size_t i = 0; i < RESIDENT; i++)
+    operateCache(block(cache, resident[i]), cache);
+  for (size_t i = 0; i < RESIDENT; i++)
+    CHECK(probe_cache(block(cache, resident[i]), cache));
+}
+
+// Does one of the resident blocks map to the set?
+static bool holds_resident(const Cache *cache, int set) {
+  for (size_t i = 0; i < RESIDENT; i++)
+    if ((int)cache_set(block(cache, resident[i]), cache) == set)
+      return true;
+  return false;
+}
+
+// flush_range drops every block the range overlaps, however little of the
+// block it covers, and nothing else.
+static void test_flush_range(void) {
+  Cache cache;
+  setup(&cache, current);
+  fill(&cache);
+
+  // Empty: nothing goes.
+  flush_range(block(&cache, 9), block(&cache, 9), &cache);
+  CHECK(probe_cache(block(&cache, 9), &cache));
+
+  // The back half of block 9 and the first byte of block 10, flushed block
+  // by block.
+  flush_range(block(&cache, 9) + (1 << cache.blockBits) / 2,
+              block(&cache, 10) + 1, &cache);
+  CHECK(probe_cache(block(&cache, 8), &cache));
+  CHECK(!probe_cache(block(&cache, 9), &cache));
+  CHECK(!probe_cache(block(&cache, 10), &cache));
+  CHECK(probe_cache(block(&cache, 11), &cache));
+  CHECK(probe_cache(block(&cache, 37), &cache));
+
+  // The last byte of block 10 through the first of block 37. Unless the
+  // cache is fully associative, that is more blocks than it has lines, so
+  // the cache is scanned instead.
+  flush_range(block(&cache, 11) - 1, block(&cache, 37) + 1, &cache);
+  CHECK(probe_cache(block(&cache, 8), &cache));
+  CHECK(!probe_cache(block(&cache, 11), &cache));
+  CHECK(!probe_cache(block(&cache, 37), &cache));
+
+  // Flushed blocks miss again, the survivor still hits.
+  CHECK(operateCache(block(&cache, 9), &cache).status != CACHE_HIT);
+  CHECK(operateCache(block(&cache, 37), &cache).status != CACHE_HIT);
+  CHECK(operateCache(block(&cache, 8), &cache).status == CACHE_HIT);
+  deallocate(&cache);
+}
+
+// Every block misses after flush_all. Repeated flushes run the direct-mapped
+// mark and the set epoch past their wraparound.
+static void test_flush_all(void) {
+  Cache cache;
+  setup(&cache, current);
+  for (int round = 0; round < 40; round++) {
+    fill(&cache);
+    flush_all(&cache);
+    for (size_t i = 0; i < RESIDENT; i++)
+      CHECK(!probe_cache(block(&cache, resident[i]), &cache));
+    for (size_t i = 0; i < RESIDENT; i++)
+      CHECK(operateCache(block(&cache, resident[i]), &cache).status !=
+            CACHE_HIT);
+    flush_all(&cache);
+  }
+  deallocate(&cache);
+
+  // Sets last used in epoch 0 must not come back when the epoch wraps to 0
+  // again, 2^32 flushes later: flush_all resets every set then instead.
+  setup(&cache, current);
+  fill(&cache);
+  cache.epoch = ~0u;
+  flush_all(&cache);
+  for (size_t i = 0; i < RESIDENT; i++)
+    CHECK(operateCache(block(&cache, resident[i]), &cache).status !=
+          CACHE_HIT);
+  deallocate(&cache);
+}
+
+// copy_set and same_set look past stale sets: a set flushed by flush_all
+// is empty, whatever its memory still holds, and a copy from it empties the
+// destination.
+static void test_copy_after_flush(void) {
+  Cache a, b;
+  int sets = 1 << current->setBits;
+  setup(&a, current);
+  setup(&b, current);
+  fill(&a);
+  flush_all(&a);
+  for (int i = 0; i < sets; i++)
+    CHECK(same_set(&a, &b, i));
+
+  // Copy a filled cache into one on another epoch.
+  fill(&a);
+  flush_all(&b);
+  copy_cache(&b, &a);
+  for (int i = 0; i < sets; i++)
+    CHECK(same_set(&a, &b, i));
+  for (size_t i = 0; i < RESIDENT; i++)
+    CHECK(probe_cache(block(&b, resident[i]), &b));
+
+  // Copy from flushed sets.
+  flush_all(&a);
+  for (int i = 0; i < sets; i++)
+    CHECK(same_set(&a, &b, i) == !holds_resident(&a, i));
+  copy_cache(&b, &a);
+  for (int i = 0; i < sets; i++)
+    CHECK(same_set(&a, &b, i));
+  for (size_t i = 0; i < RESIDENT; i++) {
+    CHECK(!probe_cache(block(&b, resident[i]), &b));
+    CHECK(operateCache(block(&b, resident[i]), &b).status != CACHE_HIT);
+  }
+  deallocate(&a);
+  deallocate(&b);
+}
+
+#define BATCH_RECORDS 5000 // more than CACHE_RANGE_CHUNK
+
+// Same result, as far as the status says the fields mean anything?
+static bool same_result(result a, result b) {
+  return a.status == b.status &&
+         (a.status == CACHE_HIT || a.insert_block == b.insert_block) &&
+         (a.status != CACHE_EVICT || a.victim_block == b.victim_block);
+}
+
+// operateCacheBatch against operateCache record by record, on a mix of
+// ops that includes records it must skip, in uneven batches. Then with no
+// ops, where every address is a load. operateCacheRange, dropping the
+// results of more records than it batches at once, must count the same.
+static void test_batch(void) {
+  static const char kinds[] = "ILSMLX";
+  static char ops[BATCH_RECORDS];
+  static unsigned long long addresses[BATCH_RECORDS];
+  static result results[BATCH_RECORDS];
+  static const int batches[] = {1, 7, 64, 1000};
+  const result untouched = {-1, 0, 0};
+  Cache serial, batch, range;
+  unsigned long long state = 1;
+
+  for (int i = 0; i < BATCH_RECORDS; i++) {
+    // A small LCG: deterministic. Half the records go to 8 hot blocks and
+    // half to 512, which gives hits, misses and evictions in every config.
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    ops[i] = kinds[(state >> 33) % 6];
+    addresses[i] = ((state >> 40) % ((state >> 63) ? 8 : 512))
+                       << current->blockBits |
+                   (state >> 20) % (1u << current->blockBits);
+    results[i] = untouched;
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    const char *batchOps = pass == 0 ? ops : NULL;
+    setup(&serial, current);
+    setup(&batch, current);
+    setup(&range, current);
+    operateCacheRange(addresses, batchOps, BATCH_RECORDS, NULL, &range);
+    for (int i = 0, b = 0; i < BATCH_RECORDS; b++) {
+      int n = batches[b % 4] < BATCH_RECORDS - i ? batches[b % 4]
+                                                 : BATCH_RECORDS - i;
+      operateCacheBatch(addresses + i, batchOps ? batchOps + i : NULL, n,
+                        results + i, &batch);
+      i += n;
+    }
+    for (int i = 0; i < BATCH_RECORDS; i++) {
+      char op = batchOps ? ops[i] : 'L';
+      if (op != 'L' && op != 'S' && op != 'M') {
+        CHECK(same_result(results[i], untouched));
+        continue;
+      }
+      result r = operateCache(addresses[i], &serial);
+      serial.hit_count += op == 'M';
+      CHECK(same_result(results[i], r));
+      results[i] = untouched;
+    }
+    CHECK(batch.hit_count == serial.hit_count);
+    CHECK(batch.miss_count == serial.miss_count);
+    CHECK(batch.eviction_count == serial.eviction_count);
+    CHECK(serial.eviction_count > 0);
+    CHECK(range.hit_count == serial.hit_count);
+    CHECK(range.miss_count == serial.miss_count);
+    CHECK(range.eviction_count == serial.eviction_count);
+    deallocate(&serial);
+    deallocate(&batch);
+    deallocate(&range);
+  }
+}
+
+int main(void) {
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    current = &configs[c];
+    test_flush_range();
+    test_flush_all();
+    test_copy_after_flush();
+    test_batch();
+  }
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All cache tests passed\n");
+  return 0;
+}
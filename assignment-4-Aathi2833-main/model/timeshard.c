@@ -0,0 +1,139 @@
+#include "timeshard.h"
+#include "xalloc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// One speculative run and the two copies of the cache it keeps.
+typedef struct run {
+  const char *ops;
+  const unsigned long long *addresses;
+  size_t warmFrom; // first warm-up record
+  size_t begin;    // first record of the run
+  size_t end;
+  result *results; // results of the run's records, from results[0]
+  Cache start;     // the warmed cache, as the run found it
+  Cache spec;      // the cache after the run
+} run;
+
+// A cold cache with the geometry and options of model.
+static void cold_copy(Cache *copy, const Cache *model) {
+  memset(copy, 0, sizeof(*copy));
+  copy->setBits = model->setBits;
+  copy->linesPerSet = model->linesPerSet;
+  copy->blockBits = model->blockBits;
+  copy->lfu = model->lfu;
+  copy->lfuAging = model->lfuAging;
+  copy->indexed = model->indexed;
+  copy->packed = model->packed;
+  cacheSetUp(copy, model->name);
+}
+
+// Simulate records [from, to), leaving their results at out[0..), or
+// dropping them when out is NULL.
+static void simulate(const char *ops, const unsigned long long *addresses,
+                     size_t from, size_t to, result *out, Cache *cache) {
+  operateCacheRange(addresses + from, ops + from, to - from, out, cache);
+}
+
+static void *speculate(void *arg) {
+  run *r = arg;
+  simulate(r->ops, r->addresses, r->warmFrom, r->begin, NULL, &r->spec);
+  copy_cache(&r->start, &r->spec);
+  simulate(r->ops, r->addresses, r->begin, r->end, r->results, &r->spec);
+  return NULL;
+}
+
+static void count_result(char op, result r, Cache *cache) {
+  if (op != 'L' && op != 'S' && op != 'M')
+    return;
+  cache->hit_count += (r.status == CACHE_HIT) + (op == 'M');
+  cache->miss_count += r.status != CACHE_HIT;
+  cache->eviction_count += r.status == CACHE_EVICT;
+}
+
+// Replace the speculative results of r with exact ones, moving cache from
+// the true state before the run to the true state after it.
+static size_t stitch(run *r, bool *converged, Cache *cache) {
+  size_t sets = (size_t)1 << cache->setBits, pending = 0, redone = 0;
+  for (size_t s = 0; s < sets; s++) {
+    converged[s] = same_set(cache, &r->start, s);
+    pending += !converged[s];
+  }
+  size_t i = r->begin;
+  for (; i < r->end && pending > 0; i++) {
+    char op = r->ops[i];
+    result *out = &r->results[i - r->begin];
+    if (op != 'L' && op != 'S' && op != 'M')
+      continue;
+    unsigned long long set = cache_set(r->addresses[i], cache);
+    if (converged[set]) {
+      count_result(op, *out, cache);
+      continue;
+    }
+    *out = operateCache(r->addresses[i], cache);
+    if (op == 'M')
+      cache->hit_count++;
+    operateCache(r->addresses[i], &r->start);
+    redone++;
+    if (same_set(cache, &r->start, set)) {
+      converged[set] = true;
+      pending--;
+    }
+  }
+  for (; i < r->end; i++)
+    count_result(r->ops[i], r->results[i - r->begin], cache);
+  for (size_t s = 0; s < sets; s++)
+    if (converged[s])
+      copy_set(cache, &r->spec, s);
+  return redone;
+}
+
+size_t timeshard_simulate(const char *ops, const unsigned long long *addresses,
+                          size_t begin, size_t end, size_t warmup,
+                          result *results, int threads, Cache *cache) {
+  size_t n = end - begin;
+  // A run shorter than one batch is not worth a thread.
+  if ((size_t)threads > n / CACHE_RANGE_CHUNK)
+    threads = n / CACHE_RANGE_CHUNK;
+  if (threads <= 1) {
+    simulate(ops, addresses, begin, end, results, cache);
+    return 0;
+  }
+
+  run *runs = xmalloc(threads * sizeof(run));
+  pthread_t *ids = xmalloc(threads * sizeof(pthread_t));
+  for (int t = 0; t < threads; t++) {
+    run *r = &runs[t];
+    r->ops = ops;
+    r->addresses = addresses;
+    r->begin = begin + n / threads * t;
+    r->end = t == threads - 1 ? end : begin + n / threads * (t + 1);
+    r->warmFrom = r->begin > warmup ? r->begin - warmup : 0;
+    r->results = results + (r->begin - begin);
+    if (t == 0)
+      continue;
+    cold_copy(&r->start, cache);
+    cold_copy(&r->spec, cache);
+    if (pthread_create(&ids[t], NULL, speculate, r) != 0) {
+      printf("Error starting time shard thread\n");
+      exit(1);
+    }
+  }
+  // The first run starts from the true state, so it is exact as it goes.
+  simulate(ops, addresses, runs[0].begin, runs[0].end, results, cache);
+  for (int t = 1; t < threads; t++)
+    pthread_join(ids[t], NULL);
+
+  size_t redone = 0;
+  bool *converged = xmalloc(((size_t)1 << cache->setBits) * sizeof(bool));
+  for (int t = 1; t < threads; t++) {
+    redone += stitch(&runs[t], converged, cache);
+    deallocate(&runs[t].start);
+    deallocate(&runs[t].spec);
+  }
+  free(converged);
+  free(ids);
+  free(runs);
+  return redone;
+}
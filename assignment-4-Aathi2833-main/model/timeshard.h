@@ -0,0 +1,29 @@
+#ifndef TIMESHARD_H
+#define TIMESHARD_H
+
+#include "cache.h"
+#include <stddef.h>
+
+#define TIMESHARD_WINDOW (1 << 22) // records simulated per round of threads
+#define TIMESHARD_WARMUP 8         // default warm-up, in records per line
+
+// Simulate records [begin, end) of a decoded trace on up to `threads`
+// threads, with the same results and counts as operateCacheBatch.
+// results[i - begin] gets the result of record i.
+//
+// The records are cut into one run per thread. The first run continues
+// from the state of the cache; each later run starts from a cold copy of
+// the cache warmed on the `warmup` records before it (which may lie before
+// begin) and is simulated speculatively, all runs at once. The runs are
+// then stitched in order. Starting from the true state at the start of a
+// run, each set is simulated again alongside a replay of the speculative
+// run, only until the two copies of the set hold the same blocks in the
+// same replacement order: from then on the speculative results of that
+// set are exact, and its final state is taken from the speculative copy.
+//
+// Returns the number of records that had to be simulated again.
+size_t timeshard_simulate(const char *ops, const unsigned long long *addresses,
+                          size_t begin, size_t end, size_t warmup,
+                          result *results, int threads, Cache *cache);
+
+#endif // TIMESHARD_H
@@ -0,0 +1,310 @@
+#include "trace.h"
+#include "../support/lackey.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Same set of characters the " " directive of scanf skips.
+static inline bool is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p))
+    p++;
+  return p;
+}
+
+static bool text_next(trace_reader *reader, trace_record *record) {
+  const char *p = reader->cursor;
+  const char *end = reader->end;
+
+  // " %c"
+  p = skip_space(p, end);
+  if (p >= end)
+    return false;
+  record->op = *p++;
+
+  // " %llx,%d"
+  p = skip_space(p, end);
+  p = lackey_parse_access(p, end, &record->address, &record->size);
+  if (p == NULL)
+    return false;
+
+  reader->cursor = p;
+  return true;
+}
+
+static const char op_codes[4] = {'I', 'L', 'S', 'M'};
+
+static inline bool read_varint(const char **cursor, const char *end,
+                               unsigned long long *value) {
+  const unsigned char *p = (const unsigned char *)*cursor;
+  unsigned long long v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if ((const char *)p >= end)
+      return false;
+    unsigned char byte = *p++;
+    v |= (unsigned long long)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *cursor = (const char *)p;
+      *value = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline long long unzigzag(unsigned long long v) {
+  return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static inline unsigned long long zigzag(long long v) {
+  return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static bool binary_next(trace_reader *reader, trace_record *record) {
+  const char *p = reader->cursor;
+  if (p >= reader->end)
+    return false;
+  unsigned char head = *p++;
+  int size = head & TRACE_SIZE_ESCAPE;
+  unsigned long long v;
+  if (size == TRACE_SIZE_ESCAPE) {
+    if (!read_varint(&p, reader->end, &v))
+      return false;
+    size = (int)unzigzag(v);
+  }
+  if (!read_varint(&p, reader->end, &v))
+    return false;
+  reader->previous += (unsigned long long)unzigzag(v);
+  record->op = op_codes[head >> 6];
+  record->address = reader->previous;
+  record->size = size;
+  reader->cursor = p;
+  return true;
+}
+
+bool trace_next(trace_reader *reader, trace_record *record) {
+  if (reader->format == TRACE_BINARY)
+    return binary_next(reader, record);
+  return text_next(reader, record);
+}
+
+// Map path into the reader as a text trace. Returns false if the file
+// cannot be opened or mapped.
+static bool map_file(trace_reader *reader, const char *path,
+                     struct stat *st) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  if (fstat(fd, st) < 0) {
+    close(fd);
+    return false;
+  }
+  reader->length = st->st_size;
+  reader->data = NULL;
+  if (reader->length > 0) {
+    void *map = mmap(NULL, reader->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    // The trace is read front to back exactly once.
+    madvise(map, reader->length, MADV_SEQUENTIAL);
+    reader->data = map;
+  }
+  close(fd);
+  reader->cursor = reader->data;
+  reader->end = reader->data + reader->length;
+  reader->format = TRACE_TEXT;
+  reader->previous = 0;
+  return true;
+}
+
+static bool has_magic(const trace_reader *reader) {
+  return reader->length >= sizeof(trace_header) &&
+         memcmp(reader->data, TRACE_MAGIC, 4) == 0;
+}
+
+static int64_t mtime_ns(const struct stat *st) {
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Switch a mapped binary trace to reading records after the header.
+static bool start_binary(trace_reader *reader) {
+  trace_header header;
+  memcpy(&header, reader->data, sizeof(header));
+  if (header.version != TRACE_VERSION || header.flags & TRACE_FLAG_TEXT_ONLY)
+    return false;
+  reader->format = TRACE_BINARY;
+  reader->cursor = reader->data + sizeof(header);
+  return true;
+}
+
+// Is the mapped sidecar a binary trace built from the text trace?
+static bool sidecar_current(const trace_reader *sidecar,
+                            const struct stat *text) {
+  trace_header header;
+  if (!has_magic(sidecar))
+    return false;
+  memcpy(&header, sidecar->data, sizeof(header));
+  return header.version == TRACE_VERSION &&
+         header.source_size == (uint64_t)text->st_size &&
+         header.source_mtime == mtime_ns(text);
+}
+
+static void open_trace(trace_reader *reader, const char *traceFile,
+                       bool convert) {
+  struct stat st;
+  if (!map_file(reader, traceFile, &st)) {
+    printf("Error reading file %s\n", traceFile);
+    exit(1);
+  }
+  if (has_magic(reader)) {
+    if (!start_binary(reader)) {
+      printf("Error reading file %s: not a usable binary trace\n", traceFile);
+      exit(1);
+    }
+    return;
+  }
+
+  // Prefer the binary sidecar, building it on first use.
+  char sidecarFile[PATH_MAX];
+  if (snprintf(sidecarFile, sizeof(sidecarFile), "%s.bin", traceFile) >=
+      (int)sizeof(sidecarFile))
+    return;
+  trace_reader sidecar;
+  struct stat sidecar_st;
+  if (map_file(&sidecar, sidecarFile, &sidecar_st)) {
+    if (sidecar_current(&sidecar, &st)) {
+      trace_header header;
+      memcpy(&header, sidecar.data, sizeof(header));
+      // Conversion already failed on this version of the trace.
+      if (header.flags & TRACE_FLAG_TEXT_ONLY) {
+        trace_close(&sidecar);
+        return;
+      }
+      if (start_binary(&sidecar)) {
+        trace_close(reader);
+        *reader = sidecar;
+        return;
+      }
+    }
+    trace_close(&sidecar);
+  }
+  if (convert && trace_convert(traceFile, sidecarFile) &&
+      map_file(&sidecar, sidecarFile, &sidecar_st)) {
+    if (sidecar_current(&sidecar, &st) && start_binary(&sidecar)) {
+      trace_close(reader);
+      *reader = sidecar;
+      return;
+    }
+    trace_close(&sidecar);
+  }
+}
+
+void trace_open(trace_reader *reader, const char *traceFile) {
+  open_trace(reader, traceFile, true);
+}
+
+void trace_open_existing(trace_reader *reader, const char *traceFile) {
+  open_trace(reader, traceFile, false);
+}
+
+void trace_close(trace_reader *reader) {
+  if (reader->data)
+    munmap((void *)reader->data, reader->length);
+  reader->data = reader->cursor = reader->end = NULL;
+  reader->length = 0;
+}
+
+void trace_slice(trace_reader *view, const char *start, const char *end) {
+  view->data = view->cursor = start;
+  view->end = end;
+  view->length = end - start;
+  view->format = TRACE_TEXT;
+  view->previous = 0;
+}
+
+static void write_varint(FILE *out, unsigned long long v) {
+  while (v >= 0x80) {
+    putc_unlocked((int)(v & 0x7f) | 0x80, out);
+    v >>= 7;
+  }
+  putc_unlocked((int)v, out);
+}
+
+bool trace_convert(const char *traceFile, const char *binFile) {
+  trace_reader input;
+  struct stat st;
+  if (!map_file(&input, traceFile, &st))
+    return false;
+
+  // Write next to the output and rename, so readers never see a partial
+  // file.
+  char tmpFile[PATH_MAX];
+  if (snprintf(tmpFile, sizeof(tmpFile), "%s.%d.tmp", binFile, (int)getpid()) >=
+      (int)sizeof(tmpFile)) {
+    trace_close(&input);
+    return false;
+  }
+  FILE *out = fopen(tmpFile, "wb");
+  if (out == NULL) {
+    trace_close(&input);
+    return false;
+  }
+
+  trace_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.source_size = st.st_size;
+  header.source_mtime = mtime_ns(&st);
+  fwrite(&header, sizeof(header), 1, out);
+
+  bool ok = true, textOnly = false;
+  trace_record record;
+  unsigned long long previous = 0;
+  while (ok && text_next(&input, &record)) {
+    const char *code = memchr(op_codes, record.op, sizeof(op_codes));
+    if (code == NULL) {
+      textOnly = true;
+      break;
+    }
+    int op = code - op_codes;
+    if (record.size >= 0 && record.size < TRACE_SIZE_ESCAPE) {
+      putc_unlocked(op << 6 | record.size, out);
+    } else {
+      putc_unlocked(op << 6 | TRACE_SIZE_ESCAPE, out);
+      write_varint(out, zigzag(record.size));
+    }
+    write_varint(out, zigzag((long long)(record.address - previous)));
+    previous = record.address;
+    header.records++;
+  }
+  trace_close(&input);
+
+  // Keep just the header, flagged, as the marker of a failed conversion.
+  if (textOnly) {
+    header.flags = TRACE_FLAG_TEXT_ONLY;
+    header.records = 0;
+    ok = fflush(out) == 0 && ftruncate(fileno(out), sizeof(header)) == 0;
+  }
+  if (ok) {
+    ok = fseek(out, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, out) == 1;
+  }
+  if (fclose(out) != 0)
+    ok = false;
+  if (ok && rename(tmpFile, binFile) != 0)
+    ok = false;
+  if (!ok)
+    unlink(tmpFile);
+  return ok && !textOnly;
+}
@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One record of a lackey trace, e.g. " L 7fefe05a8,8".
+typedef struct trace_record {
+  char op;                    // I, L, S or M
+  unsigned long long address; // accessed address
+  int size;                   // access size in bytes
+} trace_record;
+
+enum trace_format {
+  TRACE_TEXT = 0,   // lackey text, one record per line
+  TRACE_BINARY = 1  // see trace_header below
+};
+
+// Binary trace layout (little endian):
+//   trace_header
+//   per record: one byte  op << 6 | size   (op: 0 I, 1 L, 2 S, 3 M)
+//               if size == 63: varint zig-zag(size)
+//               varint zig-zag(address - previous address)
+// A size of 63 or more, or a negative size, uses the escape.
+#define TRACE_MAGIC "LKYB"
+#define TRACE_VERSION 1
+#define TRACE_SIZE_ESCAPE 63
+// A sidecar with this flag and no records marks a text trace the format
+// cannot hold, so it is read as text without trying to convert it again.
+#define TRACE_FLAG_TEXT_ONLY 1
+
+typedef struct trace_header {
+  char magic[4];          // TRACE_MAGIC
+  uint16_t version;       // TRACE_VERSION
+  uint16_t flags;         // TRACE_FLAG_*
+  uint64_t records;       // number of records that follow
+  uint64_t source_size;   // size of the text trace this was built from
+  int64_t source_mtime;   // and its modification time
+} trace_header;
+
+// Reads a trace file that is mapped read-only into memory. Records are
+// scanned in place, nothing is copied out of the mapping.
+typedef struct trace_reader {
+  const char *data;   // start of the mapping (NULL for an empty file)
+  const char *cursor; // next byte to scan
+  const char *end;    // one past the last byte of the file
+  size_t length;      // length of the mapping
+  int format;         // trace_format of the mapped file
+  unsigned long long previous; // last decoded address (binary format)
+} trace_reader;
+
+// Map the trace file. The format is picked from the magic bytes. For a
+// text trace the binary sidecar "<traceFile>.bin" is used when it is up to
+// date, and is created first when it is missing or stale. A text trace
+// that cannot be converted is read as text, and its failed conversion is
+// remembered in the sidecar until the trace changes. Exits with an error
+// message if the trace cannot be opened.
+void trace_open(trace_reader *reader, const char *traceFile);
+
+// Like trace_open, but never builds the sidecar. A text trace is only
+// replaced by a sidecar that is already up to date.
+void trace_open_existing(trace_reader *reader, const char *traceFile);
+
+// Decode the next record. Returns false at end of file or on the first
+// malformed record, like fscanf(" %c %llx,%d") != 3 would.
+bool trace_next(trace_reader *reader, trace_record *record);
+
+// Unmap the trace file.
+void trace_close(trace_reader *reader);
+
+// Point view at the text records in [start, end) of a mapped text trace.
+// The view shares the mapping and must not be closed.
+void trace_slice(trace_reader *view, const char *start, const char *end);
+
+// Convert the text trace to the binary format. Records after the first
+// malformed one are dropped, exactly as trace_next would. Returns false if
+// a record has an op other than I, L, S or M, leaving a TRACE_FLAG_TEXT_ONLY
+// marker as the output, or if the output cannot be written, leaving none.
+bool trace_convert(const char *traceFile, const char *binFile);
+
+#endif // TRACE_H
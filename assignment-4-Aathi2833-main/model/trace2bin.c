@@ -0,0 +1,24 @@
+#include "trace.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Convert a lackey text trace to the binary trace format.
+int main(int argc, char *argv[]) {
+  char binFile[PATH_MAX];
+  if (argc != 2 && argc != 3) {
+    printf("Usage: \n\
+      ./trace2bin <trace> [<output>] \n\
+      Writes <trace>.bin when no output file is given.\n");
+    exit(1);
+  }
+  if (argc == 3)
+    snprintf(binFile, sizeof(binFile), "%s", argv[2]);
+  else
+    snprintf(binFile, sizeof(binFile), "%s.bin", argv[1]);
+  if (!trace_convert(argv[1], binFile)) {
+    printf("Error converting %s to %s\n", argv[1], binFile);
+    exit(1);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef XALLOC_H
+#define XALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocation that cannot fail: like malloc, calloc and realloc, but a zero
+// size still gives a unique pointer, and running out of memory prints an
+// error and exits.
+
+static inline void *xalloc_check(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    printf("Error allocating %zu bytes\n", size);
+    exit(1);
+  }
+  return ptr;
+}
+
+static inline void *xmalloc(size_t size) {
+  return xalloc_check(malloc(size ? size : 1), size);
+}
+
+static inline void *xcalloc(size_t count, size_t size) {
+  return xalloc_check(calloc(count ? count : 1, size ? size : 1),
+                      count * size);
+}
+
+static inline void *xrealloc(void *ptr, size_t size) {
+  return xalloc_check(realloc(ptr, size ? size : 1), size);
+}
+
+#endif // XALLOC_H
@@ -0,0 +1,149 @@
+/*
+ * lackey.c - Parser for the fields of valgrind lackey trace records
+ */
+#include <immintrin.h>
+#include <stddef.h>
+#include "lackey.h"
+
+/* Value of each hex digit, 0xff for anything that is not one */
+static const unsigned char hex_value[256] = {
+    [0 ... 255] = 0xff,
+    ['0'] = 0,  ['1'] = 1,  ['2'] = 2,  ['3'] = 3,  ['4'] = 4,
+    ['5'] = 5,  ['6'] = 6,  ['7'] = 7,  ['8'] = 8,  ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+/*
+ * Shuffle indices that right-align the first n bytes of a 16-byte vector:
+ * loading 16 bytes at shift_table + n moves byte i to 16 - n + i and
+ * zeroes the bytes in front of it.
+ */
+static const unsigned char shift_table[32] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+/* Same set of characters the " " directive of scanf skips */
+static inline int is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * parse_scalar - Byte at a time parser, handles everything scanf does:
+ *     leading whitespace, a 0x prefix and a signed size.
+ */
+static const char *parse_scalar(const char *p, const char *end,
+                                unsigned long long *address, int *size) {
+    const char *digits;
+    unsigned long long value = 0;
+    int n = 0, negative = 0;
+
+    /* "%llx" */
+    while (p < end && is_space(*p))
+        p++;
+    if (p + 2 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') &&
+        hex_value[(unsigned char)p[2]] != 0xff)
+        p += 2;
+    digits = p;
+    while (p < end && hex_value[(unsigned char)*p] != 0xff)
+        value = (value << 4) | hex_value[(unsigned char)*p++];
+    if (p == digits)
+        return NULL;
+
+    /* "," */
+    if (p >= end || *p != ',')
+        return NULL;
+    p++;
+
+    /* "%d" */
+    while (p < end && is_space(*p))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        n = n * 10 + (*p++ - '0');
+    if (p == digits)
+        return NULL;
+
+    *address = value;
+    *size = negative ? -n : n;
+    return p;
+}
+
+/*
+ * parse_avx2 - Classify 32 bytes at once to find the end of the hex field,
+ *     the comma and the decimal field, then convert up to 16 hex digits
+ *     with one shuffle and a multiply-add. Anything unusual (whitespace,
+ *     a prefix or sign, more than 16 digits, fewer than 32 readable
+ *     bytes) goes to the scalar parser.
+ */
+__attribute__((target("avx2")))
+static const char *parse_avx2(const char *p, const char *end,
+                              unsigned long long *address, int *size) {
+    __m256i c, lower, is_digit, is_alpha;
+    __m128i lo, nibbles, aligned, pairs;
+    unsigned hex, comma, digit, after;
+    int len, dlen, n = 0;
+
+    if (end - p < 32)
+        return parse_scalar(p, end, address, size);
+
+    c = _mm256_loadu_si256((const __m256i *)p);
+    lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    is_alpha =
+        _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    digit = _mm256_movemask_epi8(is_digit);
+    hex = digit | _mm256_movemask_epi8(is_alpha);
+    comma = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(',')));
+
+    len = __builtin_ctz(~hex | 0x80000000u);
+    if (len == 0 || len > 16 || !((comma >> len) & 1))
+        return parse_scalar(p, end, address, size);
+    after = digit >> (len + 1);
+    dlen = __builtin_ctz(~after);
+    if (dlen == 0 || dlen > 9 || len + 1 + dlen >= 32)
+        return parse_scalar(p, end, address, size);
+
+    /* Hex digits to nibble values: '0'-'9' -> 0-9, 'a'-'f'/'A'-'F' -> 10-15 */
+    lo = _mm256_castsi256_si128(c);
+    nibbles = _mm_sub_epi8(
+        _mm_sub_epi8(_mm_or_si128(lo, _mm_set1_epi8(0x20)), _mm_set1_epi8('0')),
+        _mm_and_si128(_mm_cmpgt_epi8(lo, _mm_set1_epi8('9')),
+                      _mm_set1_epi8('a' - '0' - 10)));
+    aligned = _mm_shuffle_epi8(
+        nibbles, _mm_loadu_si128((const __m128i *)(shift_table + len)));
+    /* Most significant nibble first: each pair becomes hi * 16 + lo */
+    pairs = _mm_maddubs_epi16(aligned, _mm_set1_epi16(0x0110));
+    *address = __builtin_bswap64(
+        (unsigned long long)_mm_cvtsi128_si64(_mm_packus_epi16(pairs, pairs)));
+
+    p += len + 1;
+    while (dlen--)
+        n = n * 10 + (*p++ - '0');
+    *size = n;
+    return p;
+}
+
+static const char *(*parse_impl)(const char *, const char *,
+                                 unsigned long long *, int *) = parse_scalar;
+
+/*
+ * lackey_select - Pick the parser for this CPU once, at startup
+ */
+__attribute__((constructor))
+static void lackey_select(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        parse_impl = parse_avx2;
+}
+
+const char *lackey_parse_access(const char *p, const char *end,
+                                unsigned long long *address, int *size) {
+    return parse_impl(p, end, address, size);
+}
@@ -0,0 +1,23 @@
+/*
+ * lackey.h - Parser for the fields of valgrind lackey trace records
+ */
+
+#ifndef LACKEY_H
+#define LACKEY_H
+
+/*
+ * lackey_parse_access - Parse the "hex,dec" part of a record such as
+ *     " L 7fefe05a8,8", starting at p, the same way scanf("%llx,%d")
+ *     would. Nothing at or past end is read. Parsing stops at the first
+ *     byte that does not fit the format, so a NUL terminator ends the
+ *     record and end may be the end of the enclosing buffer. Returns the
+ *     position just past the decimal field, or NULL if the fields are
+ *     malformed.
+ *
+ *     Uses an AVX2 kernel when the CPU supports it and at least 32 bytes
+ *     are readable, and a scalar parser otherwise.
+ */
+const char *lackey_parse_access(const char *p, const char *end,
+                                unsigned long long *address, int *size);
+
+#endif /* LACKEY_H */
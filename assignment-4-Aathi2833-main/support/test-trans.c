@@ -12,6 +12,7 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "lackey.h"
 #include <sys/wait.h>  // for WEXITSTATUS
 #include <limits.h>    // for INT_MAX
 
@@ -45,8 +46,8 @@ static struct results results = {-1, 0, INT_MAX};
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b) {
-    int i, flag;
-    unsigned int len, hits, misses, evictions;
+    int i, flag, len;
+    unsigned int hits, misses, evictions;
     unsigned long long int marker_start, marker_end, addr;
     char buf[1000], cmd[255];
     char filename[128];
@@ -103,7 +104,7 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b) {
             /* We are only interested in memory access instructions */
             if (buf[0] == ' ' && buf[2] == ' ' &&
                 (buf[1] == 'S' || buf[1] == 'M' || buf[1] == 'L')) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
+                lackey_parse_access(buf+3, buf+sizeof(buf), &addr, &len);
 
                 /* If start marker found, set flag */
                 if (addr == marker_start)